@@ -0,0 +1,155 @@
+/*
+CSV -> columnar converter (../common/columnar.h)
+
+parsing text is the slow part of loading a dataset, so it is done once:
+
+1. first pass: read the header, count the rows and find the numeric columns
+   (columns where some value is not a number, e.g. "Male", are skipped)
+2. second pass: parse chunks of rows and scatter them into the columns,
+   collecting min / max statistics per block of rows
+
+the programs then map the output file (k-means / k-nn / RegressionTrees:
+./main columnar <file>, SGD trainers: ./main stream <file>).
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+
+#include "../common/columnar.h"
+
+using namespace std;
+
+vector<string> splitLine(const string &line) {
+    vector<string> fields;
+    stringstream lineStream(line);
+    string field;
+    while (getline(lineStream, field, ',')) {
+        if (!field.empty() && field.back() == '\r') field.pop_back();
+        fields.push_back(field);
+    }
+    if (!line.empty() && line.back() == ',') fields.push_back("");
+    return fields;
+}
+
+// empty fields count as missing values (NaN)
+bool parseNumber(const string &field, double &value) {
+    if (field.empty()) {
+        value = NAN;
+        return true;
+    }
+    char *end;
+    value = strtod(field.c_str(), &end);
+    return *end == '\0';
+}
+
+struct CsvSchema {
+    vector<string> names;     // of every column in the file
+    vector<bool> isNumeric;
+    bool hasHeader = false;
+    size_t numOfRows = 0;
+};
+
+// first pass, a first line that is not all numbers is the header
+CsvSchema getSchema(const string &path) {
+    ifstream file(path);
+    if (!file) throw runtime_error("cannot open " + path);
+
+    CsvSchema schema;
+    string line;
+    if (!getline(file, line)) throw runtime_error("empty file " + path);
+    vector<string> fields = splitLine(line);
+    double value;
+    for (const auto &field : fields) {
+        if (!parseNumber(field, value)) schema.hasHeader = true;
+    }
+    schema.isNumeric.assign(fields.size(), true);
+    for (size_t c=0; c<fields.size(); c++) {
+        schema.names.push_back(schema.hasHeader ? fields[c] : "c" + to_string(c));
+    }
+    if (!schema.hasHeader) schema.numOfRows++;
+
+    while (getline(file, line)) {
+        if (line.empty() || line == "\r") continue;
+        fields = splitLine(line);
+        if (fields.size() != schema.names.size()) {
+            throw runtime_error("row " + to_string(schema.numOfRows + 1) + " of " + path + " has "
+                + to_string(fields.size()) + " columns, expected " + to_string(schema.names.size()));
+        }
+        for (size_t c=0; c<fields.size(); c++) {
+            if (schema.isNumeric[c] && !parseNumber(fields[c], value)) schema.isNumeric[c] = false;
+        }
+        schema.numOfRows++;
+    }
+    return schema;
+}
+
+void convert(const string &inputPath, const string &outputPath, uint32_t blockRows) {
+    CsvSchema schema = getSchema(inputPath);
+    vector<string> names;
+    for (size_t c=0; c<schema.names.size(); c++) {
+        if (schema.isNumeric[c]) {
+            names.push_back(schema.names[c]);
+        } else {
+            cout << "skipping non-numeric column \"" << schema.names[c] << "\"" << endl;
+        }
+    }
+    if (names.empty()) throw runtime_error("no numeric columns in " + inputPath);
+
+    ColumnarWriter writer(outputPath, names, schema.numOfRows, blockRows);
+    const size_t chunkRows = 4096;
+    vector<double> rows;
+    rows.reserve(chunkRows * names.size());
+
+    ifstream file(inputPath);
+    string line;
+    if (schema.hasHeader) getline(file, line);
+    while (getline(file, line)) {
+        if (line.empty() || line == "\r") continue;
+        vector<string> fields = splitLine(line);
+        double value;
+        for (size_t c=0; c<fields.size(); c++) {
+            if (!schema.isNumeric[c]) continue;
+            parseNumber(fields[c], value);
+            rows.push_back(value);
+        }
+        if (rows.size() == chunkRows * names.size()) {
+            writer.writeRows(rows.data(), chunkRows);
+            rows.clear();
+        }
+    }
+    writer.writeRows(rows.data(), rows.size() / names.size());
+    writer.close();
+}
+
+void printSummary(const string &path) {
+    ColumnarFile file(path);
+    cout << path << ": " << file.getNumOfRows() << " rows" << endl;
+    for (size_t c=0; c<file.getNumOfCols(); c++) {
+        double min = INFINITY, max = -INFINITY;
+        for (size_t b=0; b<file.getNumOfBlocks(); b++) {
+            double blockMin, blockMax;
+            if (!file.getBlockStats(c, b, blockMin, blockMax)) break;
+            min = fmin(min, blockMin);
+            max = fmax(max, blockMax);
+        }
+        cout << "  " << c << ": " << file.getColumnName(c) << " [" << min << ", " << max << "]" << endl;
+    }
+}
+
+/**
+ * usage: ./main                                 (converts ../k-means/mall_customers.csv)
+ *        ./main <in.csv> <out.mlcf> [blockRows] (blockRows 0 = no min / max statistics)
+ */
+int main(int argc, char **argv) {
+    string inputPath = (argc > 1) ? argv[1] : "../k-means/mall_customers.csv";
+    string outputPath = (argc > 2) ? argv[2] : "mall_customers.mlcf";
+    uint32_t blockRows = (argc > 3) ? stoul(argv[3]) : 1 << 16;
+
+    convert(inputPath, outputPath, blockRows);
+    printSummary(outputPath);
+}
@@ -0,0 +1,741 @@
+/*
+Local inference server with dynamic batching
+
+serves the models written by "./main save" (../common/model.h) over a unix
+domain socket. Clients send small requests, often a single row. Every model
+has a batcher thread that collects the requests arriving within maxDelayMicros
+of the oldest queued one, up to maxBatchRows rows, and scores them with one
+predictBatch call. A connection has at most one request in flight, so the
+batch is also complete once every open connection has a request queued;
+closed-loop clients then do not wait for the deadline. The fixed cost of a
+call (thread pool fork / join, the k-nn scan of the train set, loading the
+weights) is shared by the batch.
+
+protocol (native byte order, one request at a time per connection):
+    request   uint32 type, uint32 modelIdx, uint32 numOfRows, uint32 numOfInputs,
+              double inputs[numOfRows * numOfInputs]   (PREDICT only)
+    response  uint32 status (0 = ok), uint32 numOfBytes, payload[numOfBytes]
+              PREDICT  double outputs[numOfRows * numOfOutputs]
+              STATS    JSON: per model parameter bytes, requests, rows, batches, mean batch rows,
+                       QPS and p50 / p99 latency (queueing + scoring, server side)
+              LIST     one "modelIdx type numOfInputs numOfOutputs name" line per model
+              errors   the message
+
+the load generator (./main load) runs closed-loop clients, each with its own
+connection, and reports client-side QPS and p50 / p99 latency.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../common/matrix.h"
+#include "../common/random.h"
+#include "../common/thread_pool.h"
+#include "../common/synthetic.h"
+#include "../common/model.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+enum RequestType : uint32_t { REQUEST_PREDICT = 1, REQUEST_STATS = 2, REQUEST_LIST = 3 };
+
+struct RequestHeader {
+    uint32_t type;
+    uint32_t modelIdx;
+    uint32_t numOfRows;
+    uint32_t numOfInputs;
+};
+
+struct ResponseHeader {
+    uint32_t status;
+    uint32_t numOfBytes;
+};
+
+const uint32_t MAX_REQUEST_ROWS = 1 << 16;
+// latencies kept per model for the percentiles
+const size_t LATENCY_WINDOW = 1 << 16;
+
+bool readFully(int fd, void *buffer, size_t size) {
+    char *bytes = (char*)buffer;
+    while (size > 0) {
+        ssize_t n = recv(fd, bytes, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+// MSG_NOSIGNAL: a client that went away is an error, not SIGPIPE
+bool writeFully(int fd, const void *buffer, size_t size) {
+    const char *bytes = (const char*)buffer;
+    while (size > 0) {
+        ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+sockaddr_un getSocketAddress(const string &socketPath) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) throw runtime_error("socket path too long: " + socketPath);
+    strcpy(address.sun_path, socketPath.c_str());
+    return address;
+}
+
+// q in [0, 1], nearest rank
+double getPercentile(vector<double> values, double q) {
+    if (values.empty()) return 0;
+    size_t rank = min(values.size() - 1, (size_t)(q * values.size()));
+    nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+struct PendingRequest {
+    const double *inputs;
+    size_t numOfRows;
+    double *outputs;
+    Clock::time_point arrival;
+    promise<void> done;
+};
+
+class ModelBatcher {
+public:
+    ModelBatcher(string name, unique_ptr<Model> model, size_t maxBatchRows, int maxDelayMicros)
+        : mName(name), mModel(move(model)), mMaxBatchRows(max<size_t>(1, maxBatchRows)),
+          mMaxDelay(chrono::microseconds(maxDelayMicros)) {
+        mLatencies.reserve(LATENCY_WINDOW);
+        mThread = thread([this]() { batchLoop(); });
+    }
+
+    // queued requests are still answered
+    ~ModelBatcher() {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWakeUp.notify_one();
+        mThread.join();
+    }
+
+    const string &getName() const { return mName; }
+    const Model &getModel() const { return *mModel; }
+
+    // open connections, i.e. the most requests that can be queued at once
+    void setNumOfClients(size_t numOfClients) {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mNumOfClients = numOfClients;
+        }
+        mWakeUp.notify_one();
+    }
+
+    // blocks until outputs[numOfRows * numOfOutputs] is filled
+    void predict(const double *inputs, size_t numOfRows, double *outputs) {
+        PendingRequest request;
+        request.inputs = inputs;
+        request.numOfRows = numOfRows;
+        request.outputs = outputs;
+        request.arrival = Clock::now();
+        future<void> done = request.done.get_future();
+        bool isWakeUpNeeded;
+        {
+            lock_guard<mutex> lock(mMutex);
+            // the batcher only has to run for the first request (which sets the
+            // deadline) and once the batch is complete; waking it for every
+            // request in between costs a context switch each
+            isWakeUpNeeded = mQueue.empty() || mNumOfQueuedRows + numOfRows >= mMaxBatchRows
+                || mQueue.size() + 1 >= mNumOfClients;
+            mQueue.push_back(&request);
+            mNumOfQueuedRows += numOfRows;
+        }
+        if (isWakeUpNeeded) mWakeUp.notify_one();
+        done.get();
+    }
+
+    string getStatsJson() const {
+        lock_guard<mutex> lock(mStatsMutex);
+        double seconds = chrono::duration<double>(mLastDone - mFirstArrival).count();
+        ostringstream json;
+        json << "{\"name\": \"" << mName << "\", \"type\": \"" << getModelTypeName(mModel->getType()) << "\""
+            << ", \"bytes\": " << mModel->getNumOfBytes()
+            << ", \"requests\": " << mNumOfRequests
+            << ", \"rows\": " << mNumOfRows
+            << ", \"batches\": " << mNumOfBatches
+            << ", \"meanBatchRows\": " << (mNumOfBatches > 0 ? (double)mNumOfRows / mNumOfBatches : 0)
+            << ", \"qps\": " << (seconds > 0 ? mNumOfRequests / seconds : 0)
+            << ", \"p50Micros\": " << getPercentile(mLatencies, 0.5)
+            << ", \"p99Micros\": " << getPercentile(mLatencies, 0.99) << "}";
+        return json.str();
+    }
+
+private:
+    string mName;
+    unique_ptr<Model> mModel;
+    size_t mMaxBatchRows;
+    Clock::duration mMaxDelay;
+
+    mutex mMutex;
+    condition_variable mWakeUp;
+    deque<PendingRequest*> mQueue;
+    size_t mNumOfQueuedRows = 0;
+    size_t mNumOfClients = SIZE_MAX;
+    bool mStop = false;
+    thread mThread;
+
+    // only touched by the batcher thread
+    vector<double> mBatchInputs;
+    vector<double> mBatchOutputs;
+
+    mutable mutex mStatsMutex;
+    uint64_t mNumOfRequests = 0;
+    uint64_t mNumOfRows = 0;
+    uint64_t mNumOfBatches = 0;
+    vector<double> mLatencies; // ring of the last LATENCY_WINDOW, microseconds
+    Clock::time_point mFirstArrival;
+    Clock::time_point mLastDone;
+
+    void batchLoop() {
+        unique_lock<mutex> lock(mMutex);
+        while (true) {
+            mWakeUp.wait(lock, [&]() { return mStop || !mQueue.empty(); });
+            if (mQueue.empty()) return;
+
+            // wait for more rows until the oldest request is due or no client is left to send one
+            Clock::time_point deadline = mQueue.front()->arrival + mMaxDelay;
+            while (!mStop && mNumOfQueuedRows < mMaxBatchRows && mQueue.size() < mNumOfClients
+                && mWakeUp.wait_until(lock, deadline) == cv_status::no_timeout) {}
+
+            // whole requests only, one larger than maxBatchRows runs alone
+            vector<PendingRequest*> batch;
+            size_t numOfBatchRows = 0;
+            while (!mQueue.empty()
+                && (batch.empty() || numOfBatchRows + mQueue.front()->numOfRows <= mMaxBatchRows)) {
+                batch.push_back(mQueue.front());
+                numOfBatchRows += mQueue.front()->numOfRows;
+                mQueue.pop_front();
+            }
+            mNumOfQueuedRows -= numOfBatchRows;
+            lock.unlock();
+            runBatch(batch, numOfBatchRows);
+            lock.lock();
+        }
+    }
+
+    void runBatch(const vector<PendingRequest*> &batch, size_t numOfBatchRows) {
+        size_t numOfInputs = mModel->getNumOfInputs();
+        size_t numOfOutputs = mModel->getNumOfOutputs();
+        try {
+            if (batch.size() == 1) {
+                mModel->predictBatch(batch[0]->inputs, numOfBatchRows, batch[0]->outputs);
+            } else {
+                mBatchInputs.resize(numOfBatchRows * numOfInputs);
+                mBatchOutputs.resize(numOfBatchRows * numOfOutputs);
+                size_t row = 0;
+                for (PendingRequest *request : batch) {
+                    copy(request->inputs, request->inputs + request->numOfRows * numOfInputs,
+                        mBatchInputs.begin() + row * numOfInputs);
+                    row += request->numOfRows;
+                }
+                mModel->predictBatch(mBatchInputs.data(), numOfBatchRows, mBatchOutputs.data());
+                row = 0;
+                for (PendingRequest *request : batch) {
+                    copy(mBatchOutputs.begin() + row * numOfOutputs,
+                        mBatchOutputs.begin() + (row + request->numOfRows) * numOfOutputs, request->outputs);
+                    row += request->numOfRows;
+                }
+            }
+        } catch (...) {
+            for (PendingRequest *request : batch) request->done.set_exception(current_exception());
+            return;
+        }
+
+        Clock::time_point now = Clock::now();
+        {
+            lock_guard<mutex> lock(mStatsMutex);
+            if (mNumOfRequests == 0) mFirstArrival = batch[0]->arrival;
+            for (PendingRequest *request : batch) {
+                double micros = chrono::duration<double, micro>(now - request->arrival).count();
+                if (mLatencies.size() < LATENCY_WINDOW) {
+                    mLatencies.push_back(micros);
+                } else {
+                    mLatencies[mNumOfRequests % LATENCY_WINDOW] = micros;
+                }
+                mNumOfRequests++;
+            }
+            mNumOfRows += numOfBatchRows;
+            mNumOfBatches++;
+            mLastDone = now;
+        }
+        // the requests live on the stacks of the waiting threads, so this comes last
+        for (PendingRequest *request : batch) request->done.set_value();
+    }
+};
+
+class InferenceServer {
+public:
+    InferenceServer(string socketPath, vector<unique_ptr<ModelBatcher>> batchers)
+        : mSocketPath(socketPath), mBatchers(move(batchers)) {
+        for (auto &batcher : mBatchers) batcher->setNumOfClients(0);
+    }
+
+    ~InferenceServer() { stop(); }
+
+    // a stale socket file of an earlier run is replaced
+    void start() {
+        sockaddr_un address = getSocketAddress(mSocketPath);
+        mListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (mListenFd < 0) throw runtime_error("socket: " + string(strerror(errno)));
+        unlink(mSocketPath.c_str());
+        if (::bind(mListenFd, (sockaddr*)&address, sizeof(address)) < 0 || listen(mListenFd, 128) < 0) {
+            string error = strerror(errno);
+            close(mListenFd);
+            mListenFd = -1;
+            throw runtime_error("cannot listen on " + mSocketPath + ": " + error);
+        }
+        mAcceptor = thread([this]() { acceptLoop(); });
+    }
+
+    // closes the listening socket and every connection, waits for their threads
+    void stop() {
+        if (mListenFd < 0) return;
+        mStop = true;
+        shutdown(mListenFd, SHUT_RDWR);
+        mAcceptor.join();
+        close(mListenFd);
+        mListenFd = -1;
+        unlink(mSocketPath.c_str());
+        {
+            lock_guard<mutex> lock(mConnectionsMutex);
+            for (auto &connection : mConnections) {
+                if (!connection->closed) shutdown(connection->fd, SHUT_RDWR);
+            }
+        }
+        for (auto &connection : mConnections) connection->worker.join();
+        mConnections.clear();
+    }
+
+    size_t getNumOfModels() const { return mBatchers.size(); }
+
+private:
+    string mSocketPath;
+    vector<unique_ptr<ModelBatcher>> mBatchers;
+    int mListenFd = -1;
+    atomic<bool> mStop{false};
+    thread mAcceptor;
+
+    struct Connection {
+        int fd;
+        bool closed = false; // the worker is done with fd and about to return
+        thread worker;
+    };
+
+    mutex mConnectionsMutex;
+    vector<unique_ptr<Connection>> mConnections; // guarded by mConnectionsMutex
+    size_t mNumOfConnections = 0; // guarded by mConnectionsMutex
+
+    void acceptLoop() {
+        while (!mStop) {
+            int fd = accept(mListenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return; // shut down
+            }
+            lock_guard<mutex> lock(mConnectionsMutex);
+            if (mStop) {
+                close(fd);
+                return;
+            }
+            reapConnections();
+            mConnections.push_back(make_unique<Connection>());
+            Connection *connection = mConnections.back().get();
+            connection->fd = fd;
+            updateNumOfConnections(1);
+            // the worker takes mConnectionsMutex before touching connection, so
+            // it only runs on once worker has been assigned
+            connection->worker = thread([this, connection]() {
+                serveConnection(connection->fd);
+                lock_guard<mutex> connectionsLock(mConnectionsMutex);
+                close(connection->fd);
+                connection->closed = true;
+                updateNumOfConnections(-1);
+            });
+        }
+    }
+
+    // with mConnectionsMutex held; a closed worker has released the mutex
+    // and only has to return, so joining it here cannot block for long
+    void reapConnections() {
+        auto isClosed = [](const unique_ptr<Connection> &connection) {
+            if (connection->closed) connection->worker.join();
+            return connection->closed;
+        };
+        mConnections.erase(remove_if(mConnections.begin(), mConnections.end(), isClosed), mConnections.end());
+    }
+
+    // with mConnectionsMutex held
+    void updateNumOfConnections(int change) {
+        mNumOfConnections += change;
+        for (auto &batcher : mBatchers) batcher->setNumOfClients(mNumOfConnections);
+    }
+
+    static bool sendResponse(int fd, uint32_t status, const void *payload, size_t numOfBytes) {
+        ResponseHeader header = {status, (uint32_t)numOfBytes};
+        return writeFully(fd, &header, sizeof(header)) && writeFully(fd, payload, numOfBytes);
+    }
+
+    static bool sendText(int fd, uint32_t status, const string &text) {
+        return sendResponse(fd, status, text.data(), text.size());
+    }
+
+    void serveConnection(int fd) {
+        RequestHeader header;
+        vector<double> inputs, outputs;
+        while (readFully(fd, &header, sizeof(header))) {
+            if (header.type == REQUEST_STATS) {
+                if (!sendText(fd, 0, getStatsJson())) return;
+                continue;
+            }
+            if (header.type == REQUEST_LIST) {
+                if (!sendText(fd, 0, getModelList())) return;
+                continue;
+            }
+            if (header.type != REQUEST_PREDICT) {
+                sendText(fd, 1, "unknown request type " + to_string(header.type));
+                return;
+            }
+            // the inputs are read before any check, so the stream stays in sync after an error
+            if (header.numOfRows > MAX_REQUEST_ROWS || header.numOfInputs > (1u << 20) / max(1u, header.numOfRows)) {
+                sendText(fd, 1, "request too large");
+                return;
+            }
+            inputs.resize((size_t)header.numOfRows * header.numOfInputs);
+            if (!readFully(fd, inputs.data(), inputs.size() * sizeof(double))) return;
+
+            string error;
+            if (header.modelIdx >= mBatchers.size()) {
+                error = "no model " + to_string(header.modelIdx);
+            } else if (header.numOfInputs != mBatchers[header.modelIdx]->getModel().getNumOfInputs()) {
+                error = "model " + to_string(header.modelIdx) + " takes "
+                    + to_string(mBatchers[header.modelIdx]->getModel().getNumOfInputs()) + " inputs";
+            }
+            if (!error.empty()) {
+                if (!sendText(fd, 1, error)) return;
+                continue;
+            }
+
+            ModelBatcher &batcher = *mBatchers[header.modelIdx];
+            outputs.resize(header.numOfRows * batcher.getModel().getNumOfOutputs());
+            try {
+                batcher.predict(inputs.data(), header.numOfRows, outputs.data());
+            } catch (const exception &e) {
+                if (!sendText(fd, 1, e.what())) return;
+                continue;
+            }
+            if (!sendResponse(fd, 0, outputs.data(), outputs.size() * sizeof(double))) return;
+        }
+    }
+
+    string getStatsJson() const {
+        string json = "{\"models\": [";
+        for (size_t m=0; m<mBatchers.size(); m++) {
+            json += (m > 0 ? ",\n  " : "\n  ") + mBatchers[m]->getStatsJson();
+        }
+        return json + "\n]}\n";
+    }
+
+    string getModelList() const {
+        ostringstream list;
+        for (size_t m=0; m<mBatchers.size(); m++) {
+            const Model &model = mBatchers[m]->getModel();
+            list << m << " " << getModelTypeName(model.getType()) << " " << model.getNumOfInputs()
+                << " " << model.getNumOfOutputs() << " " << mBatchers[m]->getName() << "\n";
+        }
+        return list.str();
+    }
+};
+
+class InferenceClient {
+public:
+    InferenceClient(const string &socketPath) {
+        sockaddr_un address = getSocketAddress(socketPath);
+        mFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (mFd < 0 || connect(mFd, (sockaddr*)&address, sizeof(address)) < 0) {
+            string error = strerror(errno);
+            if (mFd >= 0) close(mFd);
+            throw runtime_error("cannot connect to " + socketPath + ": " + error);
+        }
+    }
+
+    ~InferenceClient() { close(mFd); }
+
+    InferenceClient(const InferenceClient &) = delete;
+    InferenceClient &operator=(const InferenceClient &) = delete;
+
+    // outputs of numOfRows rows, numOfOutputs = outputs.size() / numOfRows
+    void predict(uint32_t modelIdx, const double *inputs, size_t numOfRows, size_t numOfInputs, vector<double> &outputs) {
+        RequestHeader header = {REQUEST_PREDICT, modelIdx, (uint32_t)numOfRows, (uint32_t)numOfInputs};
+        if (!writeFully(mFd, &header, sizeof(header))
+            || !writeFully(mFd, inputs, numOfRows * numOfInputs * sizeof(double))) {
+            throw runtime_error("connection lost");
+        }
+        vector<char> payload = receive();
+        outputs.resize(payload.size() / sizeof(double));
+        memcpy(outputs.data(), payload.data(), outputs.size() * sizeof(double));
+    }
+
+    // STATS or LIST
+    string getText(RequestType type) {
+        RequestHeader header = {type, 0, 0, 0};
+        if (!writeFully(mFd, &header, sizeof(header))) throw runtime_error("connection lost");
+        vector<char> payload = receive();
+        return string(payload.begin(), payload.end());
+    }
+
+private:
+    int mFd;
+
+    vector<char> receive() {
+        ResponseHeader header;
+        if (!readFully(mFd, &header, sizeof(header))) throw runtime_error("connection lost");
+        vector<char> payload(header.numOfBytes);
+        if (!readFully(mFd, payload.data(), payload.size())) throw runtime_error("connection lost");
+        if (header.status != 0) throw runtime_error("server: " + string(payload.begin(), payload.end()));
+        return payload;
+    }
+};
+
+// numOfInputs of every model, from LIST
+vector<size_t> getNumOfInputs(const string &socketPath) {
+    InferenceClient client(socketPath);
+    istringstream list(client.getText(REQUEST_LIST));
+    vector<size_t> numsOfInputs;
+    string line;
+    while (getline(list, line)) {
+        istringstream fields(line);
+        size_t modelIdx, numOfInputs;
+        string type;
+        fields >> modelIdx >> type >> numOfInputs;
+        numsOfInputs.push_back(numOfInputs);
+    }
+    return numsOfInputs;
+}
+
+/**
+ * closed loop: every client sends its next request as soon as the previous
+ * one is answered, inputs uniform in [-5, 5]. Returns the QPS.
+ */
+double runLoadGenerator(
+    const string &socketPath, uint32_t modelIdx,
+    int numOfClients, int numOfRequests, size_t rowsPerRequest) {
+
+    vector<size_t> numsOfInputs = getNumOfInputs(socketPath);
+    if (modelIdx >= numsOfInputs.size()) throw runtime_error("no model " + to_string(modelIdx));
+    size_t numOfInputs = numsOfInputs[modelIdx];
+
+    vector<vector<double>> latencies(numOfClients);
+    vector<string> errors(numOfClients);
+    vector<thread> clients;
+    Clock::time_point start = Clock::now();
+    for (int c=0; c<numOfClients; c++) {
+        clients.emplace_back([&, c]() {
+            try {
+                InferenceClient client(socketPath);
+                CounterRng rng(7, c);
+                vector<double> inputs(rowsPerRequest * numOfInputs), outputs;
+                for (int r=0; r<numOfRequests; r++) {
+                    for (auto &x : inputs) x = rng.uniform(-5, 5);
+                    Clock::time_point sent = Clock::now();
+                    client.predict(modelIdx, inputs.data(), rowsPerRequest, numOfInputs, outputs);
+                    latencies[c].push_back(chrono::duration<double, micro>(Clock::now() - sent).count());
+                }
+            } catch (const exception &e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    for (auto &client : clients) client.join();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    for (auto &error : errors) {
+        if (!error.empty()) throw runtime_error(error);
+    }
+
+    vector<double> allLatencies;
+    for (auto &clientLatencies : latencies) allLatencies.insert(allLatencies.end(), clientLatencies.begin(), clientLatencies.end());
+    cout << "model " << modelIdx << ": " << numOfClients << " clients x " << numOfRequests << " requests x "
+        << rowsPerRequest << " rows, " << allLatencies.size() / seconds << " QPS, p50 "
+        << getPercentile(allLatencies, 0.5) << " us, p99 " << getPercentile(allLatencies, 0.99) << " us" << endl;
+    return allLatencies.size() / seconds;
+}
+
+vector<unique_ptr<ModelBatcher>> loadModels(const vector<string> &paths, size_t maxBatchRows, int maxDelayMicros) {
+    vector<unique_ptr<ModelBatcher>> batchers;
+    for (auto &path : paths) {
+        string name = path.substr(path.find_last_of('/') + 1);
+        batchers.emplace_back(new ModelBatcher(name, Model::load(path), maxBatchRows, maxDelayMicros));
+    }
+    return batchers;
+}
+
+// complete tree of random splits in [-1, 1], leaves labeled 0 / 1
+int addRandomTreeNodes(int depth, size_t numOfInputs, CounterRng &rng, vector<TreeModelNode> &nodes) {
+    int idx = nodes.size();
+    if (depth == 0) {
+        nodes.push_back({-1, -1, -1, 0, (double)rng.below(2)});
+        return idx;
+    }
+    nodes.push_back({(int32_t)rng.below(numOfInputs), -1, -1, rng.uniform(-1, 1), -1});
+    int left = addRandomTreeNodes(depth - 1, numOfInputs, rng, nodes);
+    int right = addRandomTreeNodes(depth - 1, numOfInputs, rng, nodes);
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    return idx;
+}
+
+// one model of every type, without training, for the demo
+vector<unique_ptr<Model>> getDemoModels() {
+    const size_t numOfInputs = 8;
+    CounterRng rng(42);
+    vector<unique_ptr<Model>> models;
+
+    vector<double> coefficents;
+    getSyntheticLogistic(0, numOfInputs, 42, &coefficents);
+    models.emplace_back(new LogisticModel(coefficents));
+
+    vector<MlpLayer> layers;
+    for (auto shape : {make_pair(numOfInputs, (size_t)64), make_pair((size_t)64, (size_t)1)}) {
+        MlpLayer layer = {Matrix<double>(shape.first, shape.second), vector<double>(shape.second)};
+        for (size_t i=0; i<layer.weights.size(); i++) layer.weights.data()[i] = rng.uniform(-1, 1);
+        for (auto &bias : layer.biases) bias = rng.uniform(-1, 1);
+        layers.push_back(layer);
+    }
+    models.emplace_back(new MlpModel(layers));
+
+    vector<TreeModelNode> nodes;
+    addRandomTreeNodes(8, numOfInputs, rng, nodes);
+    models.emplace_back(new TreeModel(nodes, numOfInputs));
+
+    models.emplace_back(new KnnModel(getSyntheticBlobs(20000, numOfInputs, 8, 3.0), 5));
+    return models;
+}
+
+/**
+ * the same load against an unbatched server (maxBatchRows = 1) and a
+ * batching one, on a temporary socket. Batching pays off where scoring costs
+ * more than the round trip of a request: the k-nn scan compares every train
+ * block with up to 4 queries at once and is split over the threads.
+ */
+void runDemo(int numOfClients, int numOfRequests, int maxDelayMicros) {
+    string socketPath = "/tmp/ml-inference-" + to_string(getpid()) + ".sock";
+    vector<string> names;
+    vector<vector<double>> qps(2); // unbatched, batched
+    for (size_t maxBatchRows : {(size_t)1, (size_t)256}) {
+        vector<unique_ptr<Model>> models = getDemoModels();
+        vector<unique_ptr<ModelBatcher>> batchers;
+        names.clear();
+        for (auto &model : models) {
+            names.push_back(getModelTypeName(model->getType()));
+            string name = string("demo_") + getModelTypeName(model->getType());
+            batchers.emplace_back(new ModelBatcher(name, move(model), maxBatchRows, maxDelayMicros));
+        }
+        InferenceServer server(socketPath, move(batchers));
+        server.start();
+        cout << "maxBatchRows " << maxBatchRows << ", maxDelay " << maxDelayMicros << " us" << endl;
+        for (size_t m=0; m<server.getNumOfModels(); m++) {
+            qps[maxBatchRows > 1].push_back(runLoadGenerator(socketPath, m, numOfClients, numOfRequests, 1));
+        }
+        cout << InferenceClient(socketPath).getText(REQUEST_STATS);
+        server.stop();
+    }
+    cout << "batched / unbatched QPS:";
+    for (size_t m=0; m<names.size(); m++) cout << " " << names[m] << " " << qps[1][m] / qps[0][m] << "x";
+    cout << endl;
+}
+
+/**
+ * usage: ./main [clients] [requests] [maxDelayUs]   (demo: unbatched vs. batched on a temporary socket)
+ *        ./main serve <socket> <model.mlmd>... [--max-batch rows] [--max-delay-us us]
+ *        ./main load <socket> [modelIdx] [clients] [requests] [rowsPerRequest]
+ *        ./main stats <socket>
+ * model files come from "./main save" of MLPWithBP, LogisticRegWithSGD, RegressionTrees and k-nn
+ */
+int main(int argc, char **argv) {
+    if (argc > 2 && string(argv[1]) == "serve") {
+        string socketPath = argv[2];
+        vector<string> paths;
+        size_t maxBatchRows = 256;
+        int maxDelayMicros = 200;
+        for (int i=3; i<argc; i++) {
+            if (strcmp(argv[i], "--max-batch") == 0 && i+1 < argc) {
+                maxBatchRows = stoul(argv[++i]);
+            } else if (strcmp(argv[i], "--max-delay-us") == 0 && i+1 < argc) {
+                maxDelayMicros = stoi(argv[++i]);
+            } else {
+                paths.push_back(argv[i]);
+            }
+        }
+        if (paths.empty()) throw runtime_error("no model files");
+
+        // blocked before any thread starts, so only sigwait below sees them
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        InferenceServer server(socketPath, loadModels(paths, maxBatchRows, maxDelayMicros));
+        server.start();
+        cout << "serving " << paths.size() << " models on " << socketPath
+            << " (maxBatchRows " << maxBatchRows << ", maxDelay " << maxDelayMicros << " us)" << endl;
+        int signal;
+        sigwait(&signals, &signal);
+        server.stop();
+        return 0;
+    }
+    if (argc > 2 && string(argv[1]) == "load") {
+        string socketPath = argv[2];
+        uint32_t modelIdx = (argc > 3) ? stoul(argv[3]) : 0;
+        int numOfClients = (argc > 4) ? stoi(argv[4]) : 8;
+        int numOfRequests = (argc > 5) ? stoi(argv[5]) : 1000;
+        size_t rowsPerRequest = (argc > 6) ? stoul(argv[6]) : 1;
+        runLoadGenerator(socketPath, modelIdx, numOfClients, numOfRequests, rowsPerRequest);
+        cout << InferenceClient(socketPath).getText(REQUEST_STATS);
+        return 0;
+    }
+    if (argc > 2 && string(argv[1]) == "stats") {
+        cout << InferenceClient(argv[2]).getText(REQUEST_STATS);
+        return 0;
+    }
+
+    int numOfClients = (argc > 1) ? stoi(argv[1]) : 8;
+    int numOfRequests = (argc > 2) ? stoi(argv[2]) : 250;
+    int maxDelayMicros = (argc > 3) ? stoi(argv[3]) : 200;
+    runDemo(numOfClients, numOfRequests, maxDelayMicros);
+}
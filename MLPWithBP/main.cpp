@@ -15,27 +15,38 @@
 #include <unordered_map>
 #include <cassert>
 #include <cmath>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../common/matrix.h"
+#include "../common/random.h"
+#include "../common/thread_pool.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
+#include "../common/perf.h"
+#include "../common/model.h"
 
 using namespace std;
 
-double getUniformRandom() {
-    return 2 * ((double)rand() / RAND_MAX) - 1;
-}
-
-vector<vector<double>> getRandomWeights(int numOfInputs, int numOfOutputs) {
-    vector<vector<double>> weights(numOfInputs, vector<double>(numOfOutputs));
+Matrix<double> getRandomWeights(int numOfInputs, int numOfOutputs, CounterRng &rng) {
+    Matrix<double> weights(numOfInputs, numOfOutputs);
     for (int i=0; i<numOfInputs; i++) {
         for (int j=0; j<numOfOutputs; j++) {
-            weights[i][j] = getUniformRandom();
+            weights(i, j) = rng.uniform(-1, 1);
         }
     }
     return weights;
 }
 
-vector<double> getRandomBiases(int numOfOutputs) {
+vector<double> getRandomBiases(int numOfOutputs, CounterRng &rng) {
     vector<double> biases(numOfOutputs);
     for (int j=0; j<numOfOutputs; j++) {
-        biases[j] = getUniformRandom();
+        biases[j] = rng.uniform(-1, 1);
     }
     return biases;
 }
@@ -58,49 +69,212 @@ double dSigmoid(double cache) {
     return cache * (1.0 - cache);
 }
 
+// about this many multiply-adds per task, small layers stay on the calling thread
+const size_t LAYER_GRAIN_FLOPS = 1 << 14;
+
+inline size_t getLayerGrainSize(size_t workPerItem) {
+    return max<size_t>(1, LAYER_GRAIN_FLOPS / max<size_t>(1, workPerItem));
+}
+
+// weights is numOfInputs x numOfOutputs, so row i holds the fan-out of input i
 vector<double> linearCombine(
-    const vector<vector<double>> &weights, 
+    const Matrix<double> &weights, 
     const vector<double> &biases,
     const vector<double> &inputs) {
 
-    int numOfInputs = weights.size();
-    int numOfOutputs = weights[0].size();
+    int numOfInputs = weights.rows();
+    int numOfOutputs = weights.cols();
     assert(numOfInputs == inputs.size());
 
-    vector<double> zs(numOfOutputs);
-    for (int j=0; j<numOfOutputs; j++) {
-        zs[j] = biases[j];
+    // each task owns a block of outputs, so the sums keep the sequential order
+    vector<double> zs(biases);
+    parallelFor(0, numOfOutputs, getLayerGrainSize(numOfInputs), [&](size_t begin, size_t end) {
         for (int i=0; i<numOfInputs; i++) {
-            zs[j] += weights[i][j] * inputs[i];
+            const double *row = weights.row(i);
+            for (size_t j=begin; j<end; j++) {
+                zs[j] += row[j] * inputs[i];
+            }
         }
-    }
+    });
 
     return zs;
 }
 
+// cycle counter: rdtsc on x86, steady_clock ticks elsewhere
+inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/**
+ * Training profiler
+ *
+ * accumulates cycles and FLOPs of forward / backward / update for each layer,
+ * and periodically appends an aggregated record to a JSON (one object per line)
+ * or CSV sink, chosen by the file extension of reportPath.
+ */
+class TrainProfiler {
+
+public:
+    enum Phase { FORWARD, BACKWARD, UPDATE, NUM_OF_PHASES };
+
+    TrainProfiler(int numOfLayers, string reportPath = "", int reportEvery = 1);
+    void add(int layerIdx, Phase phase, uint64_t cycles, uint64_t flops);
+    void addSamples(uint64_t numOfSamples) { mNumOfSamples += numOfSamples; }
+    void endEpoch(int epoch);
+    void printSummary();
+
+private:
+    struct Counter {
+        uint64_t cycles = 0;
+        uint64_t flops = 0;
+    };
+    int mNumOfLayers;
+    string mReportPath;
+    int mReportEvery;
+    bool mIsCSV;
+    ofstream mSink;
+    vector<Counter> mCounters; // [layerIdx * NUM_OF_PHASES + phase], layerIdx starts from 1
+    uint64_t mNumOfSamples = 0;
+    uint64_t mStartCycle;
+    chrono::steady_clock::time_point mStartTime;
+    double getElapsedSeconds();
+    double getCyclesPerSecond();
+    void writeRecord(int epoch);
+};
+
+TrainProfiler::TrainProfiler(int numOfLayers, string reportPath, int reportEvery) {
+    mNumOfLayers = numOfLayers;
+    mReportPath = reportPath;
+    mReportEvery = max(1, reportEvery);
+    mIsCSV = reportPath.size() >= 4 && reportPath.compare(reportPath.size() - 4, 4, ".csv") == 0;
+    mCounters = vector<Counter>((numOfLayers + 1) * NUM_OF_PHASES);
+    mStartCycle = readCycleCounter();
+    mStartTime = chrono::steady_clock::now();
+
+    if (mReportPath.empty()) return;
+    mSink.open(mReportPath);
+    if (mIsCSV) {
+        mSink << "epoch,samples,seconds,samplesPerSec,gflops";
+        for (int l=1; l<=mNumOfLayers; l++) {
+            for (string phase : {"forward", "backward", "update"}) {
+                mSink << ",L" << l << "_" << phase << "_cycles";
+            }
+        }
+        mSink << "\n";
+    }
+}
+
+void TrainProfiler::add(int layerIdx, Phase phase, uint64_t cycles, uint64_t flops) {
+    Counter &counter = mCounters[layerIdx * NUM_OF_PHASES + phase];
+    counter.cycles += cycles;
+    counter.flops += flops;
+}
+
+double TrainProfiler::getElapsedSeconds() {
+    return chrono::duration<double>(chrono::steady_clock::now() - mStartTime).count();
+}
+
+// calibrated against the wall clock since construction
+double TrainProfiler::getCyclesPerSecond() {
+    double seconds = getElapsedSeconds();
+    return (seconds > 0) ? (readCycleCounter() - mStartCycle) / seconds : 0;
+}
+
+void TrainProfiler::endEpoch(int epoch) {
+    if (mSink.is_open() && (epoch + 1) % mReportEvery == 0) {
+        writeRecord(epoch);
+    }
+}
+
+void TrainProfiler::writeRecord(int epoch) {
+    double seconds = getElapsedSeconds();
+    uint64_t flops = 0;
+    for (auto counter : mCounters) flops += counter.flops;
+    double samplesPerSec = (seconds > 0) ? mNumOfSamples / seconds : 0;
+    double gflops = (seconds > 0) ? flops / seconds * 1e-9 : 0;
+
+    if (mIsCSV) {
+        mSink << epoch << "," << mNumOfSamples << "," << seconds << "," << samplesPerSec << "," << gflops;
+        for (int l=1; l<=mNumOfLayers; l++) {
+            for (int p=0; p<NUM_OF_PHASES; p++) {
+                mSink << "," << mCounters[l * NUM_OF_PHASES + p].cycles;
+            }
+        }
+        mSink << "\n";
+    } else {
+        mSink << "{\"epoch\": " << epoch
+            << ", \"samples\": " << mNumOfSamples
+            << ", \"seconds\": " << seconds
+            << ", \"samplesPerSec\": " << samplesPerSec
+            << ", \"gflops\": " << gflops
+            << ", \"layers\": {";
+        for (int l=1; l<=mNumOfLayers; l++) {
+            Counter *counters = &mCounters[l * NUM_OF_PHASES];
+            mSink << (l > 1 ? ", " : "") << "\"L" << l << "\": {"
+                << "\"forwardCycles\": " << counters[FORWARD].cycles
+                << ", \"backwardCycles\": " << counters[BACKWARD].cycles
+                << ", \"updateCycles\": " << counters[UPDATE].cycles << "}";
+        }
+        mSink << "}}\n";
+    }
+    mSink.flush();
+}
+
+void TrainProfiler::printSummary() {
+    double seconds = getElapsedSeconds();
+    double cyclesPerSecond = getCyclesPerSecond();
+    uint64_t flops = 0;
+    for (auto counter : mCounters) flops += counter.flops;
+
+    cout << "samples: " << mNumOfSamples
+        << ", seconds: " << seconds
+        << ", samples/sec: " << ((seconds > 0) ? mNumOfSamples / seconds : 0)
+        << ", GFLOP/s: " << ((seconds > 0) ? flops / seconds * 1e-9 : 0) << endl;
+    for (int l=1; l<=mNumOfLayers; l++) {
+        cout << "L" << l << ":";
+        const char *names[] = {"forward", "backward", "update"};
+        for (int p=0; p<NUM_OF_PHASES; p++) {
+            uint64_t cycles = mCounters[l * NUM_OF_PHASES + p].cycles;
+            cout << " " << names[p] << "=" << cycles << " cycles";
+            if (cyclesPerSecond > 0) cout << " (" << cycles / cyclesPerSecond * 1e3 << " ms)";
+        }
+        cout << endl;
+    }
+}
+
 class Network {
 
 public:
-    Network(int, int, int);
+    Network(int, int, int, uint64_t seed = 0);
     void printLayerWeights(string);
-    void forwardPropagate(vector<double>);
-    void backPropagate(vector<double>);
+    void forwardPropagate(const double *inputs);
+    void backPropagate(const double *gts);
     void updateWeights(double learningRate);
-    void train(const vector<vector<vector<double>>> &dataset, double learningRate, int numOfEpochs);
-    void predict(vector<double>);
+    void train(const Matrix<double> &inputs, const Matrix<double> &targets, double learningRate, int numOfEpochs);
+    double predict(const double *inputs);
+    MlpModel toModel() const;
+    void setVerbose(bool verbose) { mVerbose = verbose; }
+    void setProfiler(TrainProfiler *profiler) { mProfiler = profiler; }
 
 private:
     int mNumOfInputs;
     int mNumOfHiddens;
     int mNumOfOutputs;
-    unordered_map<string, vector<vector<double>>> mWeights;
+    unordered_map<string, Matrix<double>> mWeights;
     unordered_map<string, vector<double>> mBiases;
     unordered_map<string, vector<double>> mCaches;
     unordered_map<string, vector<double>> mDeltas;
+    bool mVerbose = true;
+    TrainProfiler *mProfiler = nullptr;
+    CounterRng mRng;
     void initWeightsAndBiases();
 };
 
-Network::Network(int numOfInputs, int numOfHidden, int numOfOutputs) {
+Network::Network(int numOfInputs, int numOfHidden, int numOfOutputs, uint64_t seed) : mRng(seed) {
     mNumOfInputs = numOfInputs;
     mNumOfHiddens = numOfHidden;
     mNumOfOutputs = numOfOutputs;
@@ -108,14 +282,12 @@ Network::Network(int numOfInputs, int numOfHidden, int numOfOutputs) {
 }
 
 void Network::initWeightsAndBiases() {
-    // srand(time(NULL));
-
-    mWeights["L1"] = getRandomWeights(mNumOfInputs, mNumOfHiddens);
-    // mBiases["L1"] = getRandomBiases(mNumOfHiddens);
+    mWeights["L1"] = getRandomWeights(mNumOfInputs, mNumOfHiddens, mRng);
+    // mBiases["L1"] = getRandomBiases(mNumOfHiddens, mRng);
     mBiases["L1"] = vector<double>(mNumOfHiddens, 0);
 
-    mWeights["L2"] = getRandomWeights(mNumOfHiddens, mNumOfOutputs);
-    // mBiases["L2"] = getRandomBiases(mNumOfOutputs);
+    mWeights["L2"] = getRandomWeights(mNumOfHiddens, mNumOfOutputs, mRng);
+    // mBiases["L2"] = getRandomBiases(mNumOfOutputs, mRng);
     mBiases["L2"] = vector<double>(mNumOfOutputs, 0);
 }
 
@@ -123,9 +295,10 @@ void Network::printLayerWeights(string layerName) {
     if (mWeights.count(layerName) == 0) return;
 
     cout << layerName << "'s weights:" << endl;    
-    for (auto row : mWeights[layerName]) {
-        for (auto val : row) {
-            cout << val << ", ";
+    const Matrix<double> &weights = mWeights[layerName];
+    for (size_t i=0; i<weights.rows(); i++) {
+        for (size_t j=0; j<weights.cols(); j++) {
+            cout << weights(i, j) << ", ";
         }
         cout << endl;
     }
@@ -136,14 +309,25 @@ void Network::printLayerWeights(string layerName) {
     cout << endl;
 }
 
-void Network::forwardPropagate(vector<double> inputs) {
-    vector<double> outputs = inputs;
+void Network::forwardPropagate(const double *inputs) {
+    PERF_REGION("mlp.forward");
+    vector<double> outputs(inputs, inputs + mNumOfInputs);
 
     mCaches["L0"] = outputs;
+    int layerIdx = 1;
     for (string layerName : {"L1", "L2"}) {
+        uint64_t start = mProfiler ? readCycleCounter() : 0;
+
         outputs = linearCombine(mWeights[layerName], mBiases[layerName], outputs);
         outputs = sigmoid(outputs);
         mCaches[layerName] = outputs;
+
+        if (mProfiler) {
+            // z = w * x + b, then sigmoid
+            uint64_t flops = 2 * mWeights[layerName].size() + outputs.size();
+            mProfiler->add(layerIdx, TrainProfiler::FORWARD, readCycleCounter() - start, flops);
+        }
+        layerIdx++;
     }
 }
 
@@ -159,8 +343,11 @@ string getNextLayerName(string layerName) {
     return "L" + newKey;
 }
 
-void Network::backPropagate(vector<double> gts) {
+void Network::backPropagate(const double *gts) {
+    PERF_REGION("mlp.backward");
+    int layerIdx = 2;
     for (string layerName : {"L2", "L1"}) {
+        uint64_t start = mProfiler ? readCycleCounter() : 0;
         int numOfOutputs = mBiases[layerName].size();
         mDeltas[layerName] = vector<double>(numOfOutputs, 0);
 
@@ -173,64 +360,277 @@ void Network::backPropagate(vector<double> gts) {
             // deltas = nextDeltas * nextWeight * dSigmoid
             string nextLayerName = getNextLayerName(layerName);
             int numOfNextOutputs = mBiases[nextLayerName].size();
-            for (int i=0; i<numOfOutputs; i++) {
-                for (int j=0; j<numOfNextOutputs; j++) {
-                    mDeltas[layerName][i] += mDeltas[nextLayerName][j] * mWeights[nextLayerName][i][j];
+            vector<double> &deltas = mDeltas[layerName];
+            const vector<double> &nextDeltas = mDeltas[nextLayerName];
+            const vector<double> &caches = mCaches[layerName];
+            const Matrix<double> &nextWeights = mWeights[nextLayerName];
+            parallelFor(0, numOfOutputs, getLayerGrainSize(numOfNextOutputs), [&](size_t begin, size_t end) {
+                for (size_t i=begin; i<end; i++) {
+                    const double *row = nextWeights.row(i);
+                    for (int j=0; j<numOfNextOutputs; j++) {
+                        deltas[i] += nextDeltas[j] * row[j];
+                    }
+                    deltas[i] *= dSigmoid(caches[i]);
                 }
-                mDeltas[layerName][i] *= dSigmoid(mCaches[layerName][i]);
-            }
+            });
+        }
+
+        if (mProfiler) {
+            uint64_t flops = (layerName == "L2")
+                ? 4 * numOfOutputs
+                : (2 * mBiases[getNextLayerName(layerName)].size() + 3) * numOfOutputs;
+            mProfiler->add(layerIdx, TrainProfiler::BACKWARD, readCycleCounter() - start, flops);
         }
+        layerIdx--;
     }
 }
 
 void Network::updateWeights(double learningRate) {
+    int layerIdx = 1;
     for (string layerName : {"L1", "L2"}) {
+        uint64_t start = mProfiler ? readCycleCounter() : 0;
         for (int i=0; i<mBiases[layerName].size(); i++) {
             mBiases[layerName][i] -= learningRate * mDeltas[layerName][i];
         }
-        for (int i=0; i<mWeights[layerName].size(); i++) {
-            for (int j=0; j<mWeights[layerName][0].size(); j++) {
-                mWeights[layerName][i][j] -= learningRate * mDeltas[layerName][j] * mCaches[getPrevLayerName(layerName)][i];
+        Matrix<double> &weights = mWeights[layerName];
+        const vector<double> &deltas = mDeltas[layerName];
+        const vector<double> &prevOutputs = mCaches[getPrevLayerName(layerName)];
+        parallelFor(0, weights.rows(), getLayerGrainSize(weights.cols()), [&](size_t begin, size_t end) {
+            for (size_t i=begin; i<end; i++) {
+                double *row = weights.row(i);
+                double scale = learningRate * prevOutputs[i];
+                for (size_t j=0; j<weights.cols(); j++) {
+                    row[j] -= scale * deltas[j];
+                }
             }
+        });
+
+        if (mProfiler) {
+            uint64_t flops = 2 * (mBiases[layerName].size() + weights.size());
+            mProfiler->add(layerIdx, TrainProfiler::UPDATE, readCycleCounter() - start, flops);
         }
+        layerIdx++;
     }
 }
 
+// row r of inputs / targets is one sample
 void Network::train(
-    const vector<vector<vector<double>>> &dataset, double learningRate, int numOfEpochs) {
+    const Matrix<double> &inputs, const Matrix<double> &targets, double learningRate, int numOfEpochs) {
 
+    assert(inputs.rows() == targets.rows());
     for (int e=0; e<numOfEpochs; e++) {
-        for (auto data : dataset) {
-            forwardPropagate(data[0]);
-            backPropagate(data[1]);
+        PERF_COUNT("mlp.samples", inputs.rows());
+        for (size_t r=0; r<inputs.rows(); r++) {
+            forwardPropagate(inputs.row(r));
+            backPropagate(targets.row(r));
             updateWeights(learningRate);
 
-            cout << data[1][0] << ":" << mCaches["L2"][0] << endl;
+            // no endl here, flushing on every sample dominates the runtime
+            if (mVerbose) cout << targets(r, 0) << ":" << mCaches["L2"][0] << "\n";
+        }
+
+        if (mProfiler) {
+            mProfiler->addSamples(inputs.rows());
+            mProfiler->endEpoch(e);
         }
-        
-        cout << "epoch: " << e << endl;
+        if (mVerbose) cout << "epoch: " << e << endl;
         //printLayerWeights("L2");
     }
 }
 
-int main () {
-    
+// first output of the network for one sample
+double Network::predict(const double *inputs) {
+    forwardPropagate(inputs);
+    return mCaches["L2"][0];
+}
+
+// weights and biases of both layers, for Model::save
+MlpModel Network::toModel() const {
+    vector<MlpLayer> layers;
+    for (string layerName : {"L1", "L2"}) {
+        layers.push_back({mWeights.at(layerName), mBiases.at(layerName)});
+    }
+    return MlpModel(layers);
+}
+
+// trains the 2-8-1 XOR network of the suite and writes it for the inference server
+void saveModel(string path, size_t numOfRows) {
+    Dataset trainSet = getSyntheticXOR(numOfRows, 2, 0.05);
+    Matrix<double> targets(trainSet.size(), 1);
+    for (size_t r=0; r<trainSet.size(); r++) targets(r, 0) = trainSet.labels[r];
+
+    Network net(2, 8, 1, 42);
+    net.setVerbose(false);
+    net.train(trainSet.features, targets, 0.5, 5);
+
+    size_t numOfCorrect = 0;
+    for (size_t r=0; r<trainSet.size(); r++) {
+        numOfCorrect += ((net.predict(trainSet.row(r)) >= 0.5) == (trainSet.labels[r] == 1));
+    }
+    net.toModel().save(path);
+    cout << "saved " << path << ", train accuracy " << (double)numOfCorrect / numOfRows << endl;
+}
+
+/**
+ * post-training int8 quantization of a network trained on the cluster parity
+ * of 16 gaussian blobs in 32 dims, calibrated on the first train rows: accuracy
+ * against the double model on held-out rows, parameter bytes and batch scoring
+ * throughput
+ */
+void runQuantization(size_t numOfRows, int numOfHiddens, string path) {
+    const int numOfInputs = 32;
+    const size_t numOfTestRows = 20000;
+    const size_t numOfCalibrationRows = min<size_t>(numOfRows, 2000);
+    // label = parity of the cluster, so the classes are not linearly separable
+    Dataset dataset = getSyntheticBlobs(numOfRows + numOfTestRows, numOfInputs, 16, 4.0);
+    for (size_t r=0; r<dataset.size(); r++) {
+        dataset.labels[r] = (int)dataset.labels[r] % 2;
+        for (int i=0; i<numOfInputs; i++) dataset.features(r, i) /= 10;
+    }
+    Matrix<double> targets(numOfRows, 1);
+    for (size_t r=0; r<numOfRows; r++) targets(r, 0) = dataset.labels[r];
+    Matrix<double> trainInputs(numOfRows, numOfInputs);
+    copy(dataset.row(0), dataset.row(0) + trainInputs.size(), trainInputs.data());
+
+    Network net(numOfInputs, numOfHiddens, 1, 42);
+    net.setVerbose(false);
+    net.train(trainInputs, targets, 0.5, 5);
+
+    MlpModel model = net.toModel();
+    QuantizedMlpModel quantized = QuantizedMlpModel::quantize(model, dataset.row(0), numOfCalibrationRows);
+
+    const double *testInputs = dataset.row(numOfRows);
+    vector<double> outputs(numOfTestRows), quantizedOutputs(numOfTestRows);
+    const int numOfRepeats = 10;
+    double seconds = timeSeconds([&]() {
+        for (int i=0; i<numOfRepeats; i++) model.predictBatch(testInputs, numOfTestRows, outputs.data());
+    });
+    double quantizedSeconds = timeSeconds([&]() {
+        for (int i=0; i<numOfRepeats; i++) quantized.predictBatch(testInputs, numOfTestRows, quantizedOutputs.data());
+    });
+
+    size_t numOfCorrect = 0, numOfQuantizedCorrect = 0, numOfAgreements = 0;
+    double maxAbsDiff = 0;
+    for (size_t r=0; r<numOfTestRows; r++) {
+        bool label = (dataset.labels[numOfRows + r] == 1);
+        numOfCorrect += ((outputs[r] >= 0.5) == label);
+        numOfQuantizedCorrect += ((quantizedOutputs[r] >= 0.5) == label);
+        numOfAgreements += ((outputs[r] >= 0.5) == (quantizedOutputs[r] >= 0.5));
+        maxAbsDiff = max(maxAbsDiff, abs(outputs[r] - quantizedOutputs[r]));
+    }
+    double accuracy = (double)numOfCorrect / numOfTestRows;
+    double quantizedAccuracy = (double)numOfQuantizedCorrect / numOfTestRows;
+    cout << numOfInputs << "-" << numOfHiddens << "-1 network, " << numOfRows << " train rows, "
+        << numOfCalibrationRows << " calibration rows" << endl;
+    cout << "accuracy: double " << accuracy << ", int8 " << quantizedAccuracy
+        << " (delta " << quantizedAccuracy - accuracy << "), agreement "
+        << (double)numOfAgreements / numOfTestRows << ", max |output diff| " << maxAbsDiff << endl;
+    cout << "parameters: double " << model.getNumOfBytes() << " bytes, int8 " << quantized.getNumOfBytes()
+        << " bytes (" << (double)model.getNumOfBytes() / quantized.getNumOfBytes() << "x smaller)" << endl;
+    cout << "throughput: double " << numOfRepeats * numOfTestRows / seconds << " rows/s, int8 "
+        << numOfRepeats * numOfTestRows / quantizedSeconds << " rows/s ("
+        << seconds / quantizedSeconds << "x)" << endl;
+    if (!path.empty()) {
+        quantized.save(path);
+        cout << "saved " << path << endl;
+    }
+}
+
+// XOR is not linearly separable, so this needs the hidden layer
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("MLPWithBP");
+    const int numOfEpochs = 5;
+    Dataset trainSet = getSyntheticXOR(numOfRows, 2, 0.05);
+    Matrix<double> targets(trainSet.size(), 1);
+    for (size_t r=0; r<trainSet.size(); r++) targets(r, 0) = trainSet.labels[r];
+
+    Network net(2, 8, 1, 42);
+    net.setVerbose(false);
+    double seconds = timeSeconds([&]() { net.train(trainSet.features, targets, 0.5, numOfEpochs); });
+
+    size_t numOfCorrect = 0;
+    for (size_t r=0; r<trainSet.size(); r++) {
+        numOfCorrect += ((net.predict(trainSet.row(r)) >= 0.5) == (trainSet.labels[r] == 1));
+    }
+    report.add("xor_2_8_1_5_epochs", numOfRows, 2, seconds,
+        {{"accuracy", (double)numOfCorrect / numOfRows}}, numOfEpochs);
+    report.write(outputPath);
+}
+
+/**
+ * usage: ./main [--quiet] [--report <stats.json|stats.csv>] [--report-every <epochs>]
+ *        ./main suite [rows] [out.json]   (synthetic XOR benchmark, JSON results)
+ *        ./main save [model.mlmd] [rows]  (trains on synthetic XOR, writes the model)
+ *        ./main quantize [rows] [hiddens] [model.mlmd]  (int8 post-training quantization vs. double)
+ */
+int main (int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "quantize") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 20000;
+        int numOfHiddens = (argc > 3) ? stoi(argv[3]) : 128;
+        string path = (argc > 4) ? argv[4] : "";
+        runQuantization(numOfRows, numOfHiddens, path);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "save") {
+        string path = (argc > 2) ? argv[2] : "mlp.mlmd";
+        size_t numOfRows = (argc > 3) ? stoul(argv[3]) : 20000;
+        saveModel(path, numOfRows);
+        return 0;
+    }
+
+    bool quiet = false;
+    string reportPath;
+    int reportEvery = 1;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[i], "--report") == 0 && i+1 < argc) {
+            reportPath = argv[++i];
+        } else if (strcmp(argv[i], "--report-every") == 0 && i+1 < argc) {
+            reportEvery = stoi(argv[++i]);
+        }
+    }
+
     Network net(2, 3, 1);
+    net.setVerbose(!quiet);
 
 
-    for (auto layerName : {"L1", "L2"}) {
-        net.printLayerWeights(layerName);
+    if (!quiet) {
+        for (auto layerName : {"L1", "L2"}) {
+            net.printLayerWeights(layerName);
+        }
     }
 
-    vector<vector<vector<double>>> dataset = {
-        {{15, 11}, {0}},
-        {{11, 19}, {0}},
-        {{7, 15}, {0}},
-        {{11, 9}, {0}},
-        {{-1, -2}, {1}},
-        {{-5, -12}, {1}},
-        {{-4, -1}, {1}},
-        {{-1, -11}, {1}},
-    };
-    net.train(dataset, 0.5, 20);
+    Dataset dataset = Dataset::fromRows({
+        {15, 11, 0},
+        {11, 19, 0},
+        {7, 15, 0},
+        {11, 9, 0},
+        {-1, -2, 1},
+        {-5, -12, 1},
+        {-4, -1, 1},
+        {-1, -11, 1},
+    });
+    Matrix<double> targets(dataset.size(), 1);
+    for (size_t r=0; r<dataset.size(); r++) targets(r, 0) = dataset.labels[r];
+
+    // profiling is only enabled when a report is requested
+    TrainProfiler *profiler = nullptr;
+    if (!reportPath.empty()) {
+        profiler = new TrainProfiler(2, reportPath, reportEvery);
+        net.setProfiler(profiler);
+    }
+
+    net.train(dataset.features, targets, 0.5, 20);
+
+    if (profiler != nullptr) {
+        profiler->printSummary();
+        delete profiler;
+    }
 }
\ No newline at end of file
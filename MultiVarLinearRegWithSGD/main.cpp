@@ -8,67 +8,408 @@ Multivariate linear regression with SGD algorithm:
         -- bias = bias - lr * (y_hat - y)
         -- weights = weight - lr * (y_hat - y) * x
 2. make predicitons
+
+estimateCoefficientsStreaming runs SGD over rows streamed from a binary,
+columnar or CSV file (../common/streaming.h), using every column but the last
+as a feature.
+
+Least squares (normal equations):
+    G = A^T A and A^T y with A = [1, X], built in one streaming pass by a
+    cache-blocked SYRK-style kernel (rows packed in blocks, lower triangle
+    accumulated tile by tile, one partial G per thread), then solved with
+    Cholesky on G + ridge * I (bias not regularized).
+    estimateCoefficientsWithQR solves the same problem with Householder QR on
+    A itself, slower but better conditioned.
 */
 
 #include <vector>
 #include <iostream>
 #include <cmath>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "../common/matrix.h"
+#include "../common/streaming.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
+#include "../common/perf.h"
 
 using namespace std;
 
 double predict(
-    const vector<double> &xs, 
+    const double *xs, 
     const vector<double> &coefficents) {
     
     double prediction = coefficents[0];
-    for (int i=0; i<xs.size(); i++) {
+    for (int i=0; i+1<coefficents.size(); i++) {
         prediction += coefficents[i+1] * xs[i];
     }
     return prediction;
 }
 
 vector<double> estimateCoefficientsWithSGD(
-    const vector<vector<double>> trainSet, 
-    const double lr, const int numOfEpochs) {
+    const Dataset &trainSet, 
+    const double lr, const int numOfEpochs, bool verbose = true) {
     
     // init weights
-    int numOfCoefficents = (trainSet[0].size() - 1) + 1;
+    int numOfCoefficents = trainSet.numOfFeatures() + 1;
+    int numOfInputDims = numOfCoefficents - 1;
     vector<double> coefficents(numOfCoefficents, 0);
     
     for (int e=0; e<numOfEpochs; e++) {
+        PERF_COUNT("linreg.sgdSamples", trainSet.size());
         double sumOfError = 0;
-        for (auto pair : trainSet) {
-            vector<double> x = {pair[0]};
-            double prediction = predict(x, coefficents);
-            double error = pow(pair[1] - prediction, 2);
+        for (int r=0; r<trainSet.size(); r++) {
+            const double *data = trainSet.row(r);
+            double label = trainSet.labels[r];
+            double prediction = coefficents[0];
+            for (int i=0; i<numOfInputDims; i++) prediction += coefficents[i+1] * data[i];
+            double error = pow(label - prediction, 2);
             sumOfError += error;
             
             // update
             //// bias = bias - lr * (y_hat - y)
-            coefficents[0] = coefficents[0] - lr * (prediction - pair[1]);
+            coefficents[0] = coefficents[0] - lr * (prediction - label);
             //// weights = weight - lr * (y_hat - y) * x
             for (int i=1; i<numOfCoefficents; i++) {
-                coefficents[i] = coefficents[i] - lr * (prediction - pair[1]) * pair[0];
+                coefficents[i] = coefficents[i] - lr * (prediction - label) * data[i-1];
             }
         }
         
+        if (verbose) {
+            cout << "epoch: " << e
+                << ", error: " << sumOfError << endl;
+        }
+    }
+    
+    return coefficents;
+}
+
+const int GRAM_BLOCK_ROWS = 64; // tail rows of the last block are zero-padded
+const int GRAM_TILE = 64;
+
+// a . b over GRAM_BLOCK_ROWS values
+inline double dotBlock(const double *a, const double *b) {
+#ifdef __AVX2__
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for (int r=0; r<GRAM_BLOCK_ROWS; r+=8) {
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + r), _mm256_loadu_pd(b + r), acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + r + 4), _mm256_loadu_pd(b + r + 4), acc1);
+    }
+    __m256d acc = _mm256_add_pd(acc0, acc1);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#else
+    double sums[4] = {0, 0, 0, 0};
+    for (int r=0; r<GRAM_BLOCK_ROWS; r+=4) {
+        for (int k=0; k<4; k++) sums[k] += a[r + k] * b[r + k];
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#endif
+}
+
+/**
+ * lower triangle of A^T A (p x p, row-major) and A^T y over rows [begin, end),
+ * A = [1, x] so p = numOfInputDims + 1
+ */
+void accumulateGram(
+    const Dataset &dataset, size_t begin, size_t end,
+    vector<double> &gram, vector<double> &aty) {
+
+    int p = dataset.numOfFeatures() + 1;
+    int numOfInputDims = p - 1;
+    vector<double> block(p * GRAM_BLOCK_ROWS);
+    vector<double> labels(GRAM_BLOCK_ROWS);
+
+    for (size_t blockBegin=begin; blockBegin<end; blockBegin+=GRAM_BLOCK_ROWS) {
+        int numOfRows = min<size_t>(GRAM_BLOCK_ROWS, end - blockBegin);
+
+        // pack the block transposed (column i of A is contiguous), bias column first
+        for (int r=0; r<numOfRows; r++) {
+            const double *data = dataset.row(blockBegin + r);
+            block[r] = 1;
+            for (int i=0; i<numOfInputDims; i++) block[(i + 1) * GRAM_BLOCK_ROWS + r] = data[i];
+            labels[r] = dataset.labels[blockBegin + r];
+        }
+        for (int i=0; i<p; i++) {
+            double *ai = &block[i * GRAM_BLOCK_ROWS];
+            for (int r=numOfRows; r<GRAM_BLOCK_ROWS; r++) ai[r] = 0;
+            double sum = 0;
+            for (int r=0; r<numOfRows; r++) sum += ai[r] * labels[r];
+            aty[i] += sum;
+        }
+
+        // G[i][j] += a_i . a_j over the block, (iTile, jTile) tiles keep G and A hot, j <= i
+        for (int iTile=0; iTile<p; iTile+=GRAM_TILE) {
+            int iEnd = min(p, iTile + GRAM_TILE);
+            for (int jTile=0; jTile<=iTile; jTile+=GRAM_TILE) {
+                for (int i=iTile; i<iEnd; i++) {
+                    const double *ai = &block[i * GRAM_BLOCK_ROWS];
+                    double *g = &gram[i * p];
+                    int jEnd = min(i + 1, jTile + GRAM_TILE);
+                    for (int j=jTile; j<jEnd; j++) {
+                        const double *aj = &block[j * GRAM_BLOCK_ROWS];
+                        g[j] += dotBlock(ai, aj);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// one pass over the dataset, one partial Gram matrix per thread
+void getNormalEquations(
+    const Dataset &dataset, vector<double> &gram, vector<double> &aty,
+    int numOfThreads = thread::hardware_concurrency()) {
+
+    int p = dataset.numOfFeatures() + 1;
+    numOfThreads = max(1, min<int>(numOfThreads, dataset.size() / GRAM_BLOCK_ROWS));
+    vector<vector<double>> grams(numOfThreads, vector<double>(p * p, 0));
+    vector<vector<double>> atys(numOfThreads, vector<double>(p, 0));
+
+    size_t chunkSize = (dataset.size() + numOfThreads - 1) / numOfThreads;
+    vector<thread> workers;
+    for (int t=0; t<numOfThreads; t++) {
+        size_t begin = min(dataset.size(), t * chunkSize);
+        size_t end = min(dataset.size(), begin + chunkSize);
+        workers.emplace_back(accumulateGram, cref(dataset), begin, end, ref(grams[t]), ref(atys[t]));
+    }
+    for (auto &w : workers) w.join();
+
+    gram = grams[0];
+    aty = atys[0];
+    for (int t=1; t<numOfThreads; t++) {
+        for (int i=0; i<p*p; i++) gram[i] += grams[t][i];
+        for (int i=0; i<p; i++) aty[i] += atys[t][i];
+    }
+    // mirror the lower triangle
+    for (int i=0; i<p; i++) {
+        for (int j=i+1; j<p; j++) gram[i * p + j] = gram[j * p + i];
+    }
+}
+
+// min |A w - y|^2 + ridge * |w_1..|^2 via the normal equations, empty if G is singular
+vector<double> estimateCoefficientsWithNormalEquations(
+    const Dataset &trainSet, double ridge = 0,
+    int numOfThreads = thread::hardware_concurrency()) {
+
+    int p = trainSet.numOfFeatures() + 1;
+    vector<double> gram, aty;
+    getNormalEquations(trainSet, gram, aty, numOfThreads);
+    for (int i=1; i<p; i++) gram[i * p + i] += ridge;
+    if (!solveCholesky(gram, aty, p)) return {};
+    return aty;
+}
+
+// same problem by Householder QR on A (ridge rows appended as sqrt(ridge) * I)
+vector<double> estimateCoefficientsWithQR(const Dataset &trainSet, double ridge = 0) {
+    int p = trainSet.numOfFeatures() + 1;
+    int numOfInputDims = p - 1;
+    int numOfRidgeRows = (ridge > 0) ? numOfInputDims : 0;
+    size_t m = trainSet.size() + numOfRidgeRows;
+
+    // column-major copy of A and y
+    vector<double> A(m * p, 0), y(m, 0);
+    for (size_t r=0; r<trainSet.size(); r++) {
+        A[r] = 1;
+        for (int i=0; i<numOfInputDims; i++) A[(i + 1) * m + r] = trainSet.features(r, i);
+        y[r] = trainSet.labels[r];
+    }
+    for (int i=0; i<numOfRidgeRows; i++) A[(i + 1) * m + trainSet.size() + i] = sqrt(ridge);
+
+    for (int k=0; k<p; k++) {
+        double *ak = &A[k * m];
+        double norm = 0;
+        for (size_t r=k; r<m; r++) norm += ak[r] * ak[r];
+        norm = sqrt(norm);
+        if (norm == 0) continue;
+        double alpha = (ak[k] > 0) ? -norm : norm;
+        // v = a_k - alpha * e_k, stored in place of a_k[k..m)
+        ak[k] -= alpha;
+        double vv = 0;
+        for (size_t r=k; r<m; r++) vv += ak[r] * ak[r];
+
+        for (int j=k+1; j<p; j++) {
+            double *aj = &A[j * m];
+            double vaj = 0;
+            for (size_t r=k; r<m; r++) vaj += ak[r] * aj[r];
+            double scale = 2 * vaj / vv;
+            for (size_t r=k; r<m; r++) aj[r] -= scale * ak[r];
+        }
+        double vy = 0;
+        for (size_t r=k; r<m; r++) vy += ak[r] * y[r];
+        double scale = 2 * vy / vv;
+        for (size_t r=k; r<m; r++) y[r] -= scale * ak[r];
+
+        ak[k] = alpha; // R[k][k]
+    }
+
+    // back substitution on R w = Q^T y
+    vector<double> coefficents(p);
+    for (int i=p-1; i>=0; i--) {
+        double value = y[i];
+        for (int j=i+1; j<p; j++) value -= A[j * m + i] * coefficents[j];
+        coefficents[i] = value / A[i * m + i];
+    }
+    return coefficents;
+}
+
+double getMeanSquaredError(const Dataset &dataset, const vector<double> &coefficents) {
+    double sumOfError = 0;
+    for (int r=0; r<dataset.size(); r++) {
+        sumOfError += pow(dataset.labels[r] - predict(dataset.row(r), coefficents), 2);
+    }
+    return sumOfError / dataset.size();
+}
+
+// normal equations / QR vs. SGD epochs until within 1% of the optimal MSE
+void benchmarkSolvers(int numOfRows, int maxEpochs) {
+    for (int numOfInputDims : {10, 100, 1000}) {
+        Dataset trainSet = getSyntheticLinear(numOfRows, numOfInputDims, 0.1, 3);
+        cout << "rows: " << numOfRows << ", features: " << numOfInputDims << endl;
+
+        auto timeIt = [](function<vector<double>()> solve, vector<double> &coefficents) {
+            auto start = chrono::steady_clock::now();
+            coefficents = solve();
+            return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        };
+
+        vector<double> coefficents;
+        double seconds = timeIt([&]() { return estimateCoefficientsWithNormalEquations(trainSet, 1e-6); }, coefficents);
+        double optimalMSE = getMeanSquaredError(trainSet, coefficents);
+        cout << "  normal equations: " << seconds << "s, mse: " << optimalMSE << endl;
+
+        if (numOfInputDims <= 100) {
+            seconds = timeIt([&]() { return estimateCoefficientsWithQR(trainSet, 1e-6); }, coefficents);
+            cout << "  QR: " << seconds << "s, mse: " << getMeanSquaredError(trainSet, coefficents) << endl;
+        }
+
+        // one epoch at a time, so the MSE check is not timed
+        double lr = 0.3 / numOfInputDims;
+        double sgdSeconds = 0, mse = INFINITY;
+        int epochs = 0;
+        coefficents = vector<double>(numOfInputDims + 1, 0);
+        while (epochs < maxEpochs && mse > 1.01 * optimalMSE) {
+            auto start = chrono::steady_clock::now();
+            for (int r=0; r<numOfRows; r++) {
+                const double *data = trainSet.row(r);
+                double prediction = coefficents[0];
+                for (int i=0; i<numOfInputDims; i++) prediction += coefficents[i+1] * data[i];
+                double diff = prediction - trainSet.labels[r];
+                coefficents[0] -= lr * diff;
+                for (int i=0; i<numOfInputDims; i++) coefficents[i+1] -= lr * diff * data[i];
+            }
+            sgdSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            epochs++;
+            mse = getMeanSquaredError(trainSet, coefficents);
+        }
+        cout << "  SGD (lr=" << lr << "): " << epochs << " epochs, " << sgdSeconds << "s, mse: " << mse
+            << ((mse > 1.01 * optimalMSE) ? " (not within 1%)" : "") << endl;
+    }
+}
+
+vector<double> estimateCoefficientsStreaming(
+    const string &path, const double lr, const int numOfEpochs,
+    size_t chunkRows = 1 << 16, size_t shuffleWindow = 4096) {
+
+    RowStream stream(path, chunkRows, shuffleWindow);
+    int numOfInputDims = stream.getNumOfCols() - 1;
+    vector<double> coefficents(numOfInputDims + 1, 0);
+
+    for (int e=0; e<numOfEpochs; e++) {
+        double sumOfError = 0;
+        stream.forEachRow([&](const double *data) {
+            double prediction = coefficents[0];
+            for (int i=0; i<numOfInputDims; i++) prediction += coefficents[i+1] * data[i];
+            double diff = prediction - data[numOfInputDims];
+            sumOfError += diff * diff;
+
+            coefficents[0] = coefficents[0] - lr * diff;
+            for (int i=1; i<=numOfInputDims; i++) {
+                coefficents[i] = coefficents[i] - lr * diff * data[i-1];
+            }
+        }, e);
+
         cout << "epoch: " << e
             << ", error: " << sumOfError << endl;
     }
-    
+
     return coefficents;
 }
 
-int main() {
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("MultiVarLinearRegWithSGD");
+    const int numOfEpochs = 5;
+    for (int numOfInputDims : {10, 100}) {
+        Dataset trainSet = getSyntheticLinear(numOfRows, numOfInputDims, 0.1, 3);
+        vector<double> coefficents;
+
+        double seconds = timeSeconds([&]() { coefficents = estimateCoefficientsWithNormalEquations(trainSet, 1e-6); });
+        report.add("normal_equations", numOfRows, numOfInputDims, seconds,
+            {{"mse", getMeanSquaredError(trainSet, coefficents)}});
+
+        seconds = timeSeconds([&]() { coefficents = estimateCoefficientsWithQR(trainSet, 1e-6); });
+        report.add("qr", numOfRows, numOfInputDims, seconds,
+            {{"mse", getMeanSquaredError(trainSet, coefficents)}});
+
+        seconds = timeSeconds([&]() {
+            coefficents = estimateCoefficientsWithSGD(trainSet, 0.3 / numOfInputDims, numOfEpochs, false);
+        });
+        report.add("sgd_5_epochs", numOfRows, numOfInputDims, seconds,
+            {{"mse", getMeanSquaredError(trainSet, coefficents)}}, numOfEpochs);
+    }
+    report.write(outputPath);
+}
+
+/**
+ * usage: ./main                         (in-memory training)
+ *        ./main stream [path] [epochs]  (out-of-core training over a binary / columnar / CSV file)
+ *        ./main bench [rows] [epochs]   (normal equations / QR vs. SGD, 10-1000 features)
+ *        ./main suite [rows] [out.json] (synthetic benchmark, JSON results)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
     
-    vector<vector<double>> trainSet = {
+    Dataset trainSet = Dataset::fromRows({
         {1, 1},
         {2, 3},
         {4, 3},
         {3, 2},
         {5, 5}
-    };
+    });
     
+    if (argc > 1 && string(argv[1]) == "bench") {
+        int numOfRows = (argc > 2) ? stoi(argv[2]) : 20000;
+        int maxEpochs = (argc > 3) ? stoi(argv[3]) : 200;
+        benchmarkSolvers(numOfRows, maxEpochs);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "stream") {
+        string path = (argc > 2) ? argv[2] : "";
+        int numOfEpochs = (argc > 3) ? stoi(argv[3]) : 50;
+        if (path.empty()) {
+            path = "trainSet.bin";
+            writeBinaryRows(path, trainSet);
+        }
+        vector<double> coefficents = estimateCoefficientsStreaming(path, 0.001, numOfEpochs);
+        cout << "coefficents = {";
+        for (int i=0; i<coefficents.size(); i++) cout << (i ? ", " : "") << coefficents[i];
+        cout << "}" << endl;
+        return 0;
+    }
+
     // vector<double> coefficents = {0.4, 0.8};
     double lr = 0.001;
     int numOfEpochs = 50;
@@ -77,7 +418,12 @@ int main() {
         << coefficents[0] << ", "
         << coefficents[1] << "}"<< endl;
     
-    for (auto pair : trainSet) {
-        cout << predict({pair[0]}, coefficents) << endl;
+    for (int r=0; r<trainSet.size(); r++) {
+        cout << predict(trainSet.row(r), coefficents) << endl;
     }
+
+    vector<double> exact = estimateCoefficientsWithNormalEquations(trainSet);
+    cout << "least squares coefficents = {"
+        << exact[0] << ", "
+        << exact[1] << "}" << endl;
 }
\ No newline at end of file
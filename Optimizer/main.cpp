@@ -6,10 +6,37 @@ Adam algorithm
 3. bias correction for moving average
 4. update weights
 
+Flat optimizers (FlatSGDOptimizer, FlatAdamOptimizer) own the moment buffers
+of a whole parameter array, cache the bias-correction terms once per step and
+apply the update in one fused SIMD pass, split across threads for large tensors.
+
+SparseAdamOptimizer takes (index, gradient) pairs and decays the moments of an
+index lazily: when it is touched again after k skipped steps, its moments are
+scaled by beta^k, which is what k dense steps with zero gradient would have
+done to m and v, and the bias correction uses the global step. The weight
+itself is not moved on the skipped steps (dense Adam would still apply the
+decaying momentum there), so this is an approximation of dense Adam, like
+"lazy Adam". Per-step cost scales with the number of nonzeros, not the model
+size.
+
 */
 
 #include <iostream>
 #include <cmath>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "../common/matrix.h"
 
 using namespace std;
 
@@ -24,7 +51,7 @@ public:
 
     void update(int t, float &weight, float dWeight) {
         // 2. calculate moving averate
-        mMovingAvg = mMomentum * mMovingAvg + (1 - mMovingAvg) * dWeight;
+        mMovingAvg = mMomentum * mMovingAvg + (1 - mMomentum) * dWeight;
         // 3. bias correction
         float correctedMovingAvg = mMovingAvg / (1 - pow(mMomentum, t));
         // 4. update weights
@@ -72,6 +99,503 @@ private:
     float mMovingAvgOfRMS;
 };
 
+// run func(begin, end) over contiguous chunks of [0, size), one thread per chunk
+// once every thread gets at least minChunkSize elements
+template <typename Func>
+void parallelChunks(size_t size, size_t minChunkSize, int maxThreads, Func func) {
+    size_t numOfThreads = min<size_t>(max(1, maxThreads), size / minChunkSize);
+    if (numOfThreads <= 1) {
+        func(0, size);
+        return;
+    }
+
+    // keep chunk boundaries on SIMD-width multiples
+    size_t chunkSize = ((size + numOfThreads - 1) / numOfThreads + 7) & ~size_t(7);
+    vector<thread> workers;
+    for (size_t begin=chunkSize; begin<size; begin+=chunkSize) {
+        workers.emplace_back(func, begin, min(size, begin + chunkSize));
+    }
+    func(0, min(size, chunkSize));
+    for (auto &worker : workers) worker.join();
+}
+
+const size_t MIN_PARAMS_PER_THREAD = 1 << 16;
+
+class FlatSGDOptimizer {
+public:
+    FlatSGDOptimizer(size_t numOfParams, float learningRate=0.01, float momentum=0.9) {
+        mLearningRate = learningRate;
+        mMomentum = momentum;
+        mMovingAvg = vector<float>(numOfParams, 0);
+    }
+
+    void setNumOfThreads(int numOfThreads) { mNumOfThreads = numOfThreads; }
+    size_t getStateBytes() const { return mMovingAvg.size() * sizeof(float); }
+
+    void step(float *weights, const float *dWeights) {
+        mT++;
+        mMomentumPow *= mMomentum;
+        // bias correction and learning rate folded into one scale per step
+        float scale = mLearningRate / (1 - mMomentumPow);
+
+        parallelChunks(mMovingAvg.size(), MIN_PARAMS_PER_THREAD, mNumOfThreads,
+            [&](size_t begin, size_t end) {
+                updateRange(weights, dWeights, begin, end, scale);
+            });
+    }
+
+private:
+    float mLearningRate;
+    float mMomentum;
+    vector<float> mMovingAvg;
+    int mT = 0;
+    double mMomentumPow = 1;
+    int mNumOfThreads = thread::hardware_concurrency();
+
+    void updateRange(float *weights, const float *dWeights, size_t begin, size_t end, float scale) {
+        float *movingAvg = mMovingAvg.data();
+        size_t i = begin;
+#ifdef __AVX__
+        __m256 momentum = _mm256_set1_ps(mMomentum);
+        __m256 oneMinusMomentum = _mm256_set1_ps(1 - mMomentum);
+        __m256 vScale = _mm256_set1_ps(scale);
+        for (; i+8<=end; i+=8) {
+            __m256 g = _mm256_loadu_ps(dWeights + i);
+            __m256 m = _mm256_add_ps(_mm256_mul_ps(momentum, _mm256_loadu_ps(movingAvg + i)),
+                                     _mm256_mul_ps(oneMinusMomentum, g));
+            _mm256_storeu_ps(movingAvg + i, m);
+            _mm256_storeu_ps(weights + i, _mm256_sub_ps(_mm256_loadu_ps(weights + i), _mm256_mul_ps(vScale, m)));
+        }
+#endif
+        for (; i<end; i++) {
+            movingAvg[i] = mMomentum * movingAvg[i] + (1 - mMomentum) * dWeights[i];
+            weights[i] -= scale * movingAvg[i];
+        }
+    }
+};
+
+class FlatAdamOptimizer {
+public:
+    FlatAdamOptimizer(size_t numOfParams, float learningRate=0.01, float beta1=0.9, float beta2=0.999, float epsilon=1e-8) {
+        mLearningRate = learningRate;
+        mBeta1 = beta1;
+        mBeta2 = beta2;
+        mEpsilon = epsilon;
+        mMovingAvg = vector<float>(numOfParams, 0);
+        mMovingAvgOfRMS = vector<float>(numOfParams, 0);
+    }
+
+    void setNumOfThreads(int numOfThreads) { mNumOfThreads = numOfThreads; }
+    size_t getStateBytes() const { return (mMovingAvg.size() + mMovingAvgOfRMS.size()) * sizeof(float); }
+
+    void step(float *weights, const float *dWeights) {
+        mT++;
+        mBeta1Pow *= mBeta1;
+        mBeta2Pow *= mBeta2;
+        // lr / (1 - beta1^t) and 1 / (1 - beta2^t), once per step
+        float scale1 = mLearningRate / (1 - mBeta1Pow);
+        float scale2 = 1 / (1 - mBeta2Pow);
+
+        parallelChunks(mMovingAvg.size(), MIN_PARAMS_PER_THREAD, mNumOfThreads,
+            [&](size_t begin, size_t end) {
+                updateRange(weights, dWeights, begin, end, scale1, scale2);
+            });
+    }
+
+private:
+    float mLearningRate;
+    float mBeta1, mBeta2;
+    float mEpsilon;
+    vector<float> mMovingAvg;
+    vector<float> mMovingAvgOfRMS;
+    int mT = 0;
+    double mBeta1Pow = 1, mBeta2Pow = 1;
+    int mNumOfThreads = thread::hardware_concurrency();
+
+    void updateRange(float *weights, const float *dWeights, size_t begin, size_t end, float scale1, float scale2) {
+        float *movingAvg = mMovingAvg.data();
+        float *movingAvgOfRMS = mMovingAvgOfRMS.data();
+        size_t i = begin;
+#ifdef __AVX__
+        __m256 beta1 = _mm256_set1_ps(mBeta1), oneMinusBeta1 = _mm256_set1_ps(1 - mBeta1);
+        __m256 beta2 = _mm256_set1_ps(mBeta2), oneMinusBeta2 = _mm256_set1_ps(1 - mBeta2);
+        __m256 vScale1 = _mm256_set1_ps(scale1), vScale2 = _mm256_set1_ps(scale2);
+        __m256 epsilon = _mm256_set1_ps(mEpsilon);
+        for (; i+8<=end; i+=8) {
+            __m256 g = _mm256_loadu_ps(dWeights + i);
+            __m256 m = _mm256_add_ps(_mm256_mul_ps(beta1, _mm256_loadu_ps(movingAvg + i)),
+                                     _mm256_mul_ps(oneMinusBeta1, g));
+            __m256 v = _mm256_add_ps(_mm256_mul_ps(beta2, _mm256_loadu_ps(movingAvgOfRMS + i)),
+                                     _mm256_mul_ps(oneMinusBeta2, _mm256_mul_ps(g, g)));
+            _mm256_storeu_ps(movingAvg + i, m);
+            _mm256_storeu_ps(movingAvgOfRMS + i, v);
+            __m256 denom = _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(v, vScale2)), epsilon);
+            __m256 delta = _mm256_div_ps(_mm256_mul_ps(vScale1, m), denom);
+            _mm256_storeu_ps(weights + i, _mm256_sub_ps(_mm256_loadu_ps(weights + i), delta));
+        }
+#endif
+        for (; i<end; i++) {
+            float g = dWeights[i];
+            movingAvg[i] = mBeta1 * movingAvg[i] + (1 - mBeta1) * g;
+            movingAvgOfRMS[i] = mBeta2 * movingAvgOfRMS[i] + (1 - mBeta2) * (g * g);
+            weights[i] -= scale1 * movingAvg[i] / (sqrt(movingAvgOfRMS[i] * scale2) + mEpsilon);
+        }
+    }
+};
+
+class SparseAdamOptimizer {
+public:
+    SparseAdamOptimizer(size_t numOfParams, float learningRate=0.01, float beta1=0.9, float beta2=0.999, float epsilon=1e-8) {
+        mLearningRate = learningRate;
+        mBeta1 = beta1;
+        mBeta2 = beta2;
+        mEpsilon = epsilon;
+        mMovingAvg = vector<float>(numOfParams, 0);
+        mMovingAvgOfRMS = vector<float>(numOfParams, 0);
+        mLastStep = vector<int>(numOfParams, 0);
+        mBeta1Pows.resize(POW_TABLE_SIZE);
+        mBeta2Pows.resize(POW_TABLE_SIZE);
+        mBeta1Pows[0] = mBeta2Pows[0] = 1;
+        for (int k=1; k<POW_TABLE_SIZE; k++) {
+            mBeta1Pows[k] = mBeta1Pows[k-1] * beta1;
+            mBeta2Pows[k] = mBeta2Pows[k-1] * beta2;
+        }
+    }
+
+    size_t getStateBytes() const {
+        return (mMovingAvg.size() + mMovingAvgOfRMS.size()) * sizeof(float) + mLastStep.size() * sizeof(int)
+            + (mBeta1Pows.size() + mBeta2Pows.size()) * sizeof(double);
+    }
+
+    // indices must be unique within one step, untouched indices have a zero gradient
+    void step(float *weights, const vector<pair<uint32_t, float>> &sparseGrads) {
+        mT++;
+        float scale1 = mLearningRate / (1 - getPow(mBeta1Pows, mBeta1, mT));
+        float scale2 = 1 / (1 - getPow(mBeta2Pows, mBeta2, mT));
+
+        for (auto &item : sparseGrads) {
+            uint32_t i = item.first;
+            float g = item.second;
+
+            // catch up the decay of the (mT - 1 - mLastStep[i]) zero-gradient steps
+            int numOfSkipped = mT - 1 - mLastStep[i];
+            float m = mMovingAvg[i] * (float)getPow(mBeta1Pows, mBeta1, numOfSkipped);
+            float v = mMovingAvgOfRMS[i] * (float)getPow(mBeta2Pows, mBeta2, numOfSkipped);
+
+            m = mBeta1 * m + (1 - mBeta1) * g;
+            v = mBeta2 * v + (1 - mBeta2) * (g * g);
+            weights[i] -= scale1 * m / (sqrt(v * scale2) + mEpsilon);
+
+            mMovingAvg[i] = m;
+            mMovingAvgOfRMS[i] = v;
+            mLastStep[i] = mT;
+        }
+    }
+
+private:
+    float mLearningRate;
+    float mBeta1, mBeta2;
+    float mEpsilon;
+    vector<float> mMovingAvg;
+    vector<float> mMovingAvgOfRMS;
+    vector<int> mLastStep;
+    int mT = 0;
+    // beta^k for k < POW_TABLE_SIZE, so catching up is usually a table lookup instead of pow()
+    static constexpr int POW_TABLE_SIZE = 4096;
+    vector<double> mBeta1Pows, mBeta2Pows;
+
+    static double getPow(const vector<double> &pows, float beta, int k) {
+        return (k < POW_TABLE_SIZE) ? pows[k] : pow((double)beta, k);
+    }
+};
+
+// per-step time of sparse vs. dense Adam at a fixed number of nonzeros
+void benchmarkSparse(size_t numOfNonzeros, int numOfSteps) {
+    auto now = []() { return chrono::steady_clock::now(); };
+
+    for (size_t numOfParams : {size_t(1) << 16, size_t(1) << 20, size_t(1) << 24}) {
+        if (numOfNonzeros > numOfParams) {
+            cout << "params: " << numOfParams << ", nnz: " << numOfNonzeros << " > params, skipped" << endl;
+            continue;
+        }
+        vector<float> weights(numOfParams, 0);
+        vector<float> denseGrads(numOfParams, 0);
+        vector<vector<pair<uint32_t, float>>> sparseGrads(numOfSteps);
+        for (auto &grads : sparseGrads) {
+            // a strided pattern keeps indices unique without a hash set
+            size_t stride = numOfParams / numOfNonzeros, offset = rand() % stride;
+            for (size_t j=0; j<numOfNonzeros; j++) {
+                grads.push_back({(uint32_t)(j * stride + offset), (float)rand() / RAND_MAX - 0.5f});
+            }
+        }
+
+        SparseAdamOptimizer sparseOpt(numOfParams);
+        auto start = now();
+        for (auto &grads : sparseGrads) sparseOpt.step(weights.data(), grads);
+        double sparseSeconds = chrono::duration<double>(now() - start).count() / numOfSteps;
+
+        FlatAdamOptimizer denseOpt(numOfParams);
+        start = now();
+        for (auto &grads : sparseGrads) {
+            for (auto &item : grads) denseGrads[item.first] = item.second;
+            denseOpt.step(weights.data(), denseGrads.data());
+            for (auto &item : grads) denseGrads[item.first] = 0;
+        }
+        double denseSeconds = chrono::duration<double>(now() - start).count() / numOfSteps;
+
+        cout << "params: " << numOfParams << ", nnz: " << numOfNonzeros
+            << ", sparse: " << sparseSeconds * 1e6 << " us/step"
+            << ", dense: " << denseSeconds * 1e6 << " us/step" << endl;
+    }
+}
+
+// parameters updated per second: one optimizer object per parameter vs. flat buffers
+void benchmarkThroughput(size_t numOfParams, int numOfSteps) {
+    vector<float> weights(numOfParams, 0);
+    vector<float> dWeights(numOfParams);
+    for (size_t i=0; i<numOfParams; i++) dWeights[i] = (float)rand() / RAND_MAX - 0.5f;
+
+    auto report = [&](string name, double seconds) {
+        cout << name << ": " << numOfParams * (double)numOfSteps / seconds << " params/sec" << endl;
+    };
+    auto now = []() { return chrono::steady_clock::now(); };
+
+    {
+        vector<AdamOptimizer> opts(numOfParams);
+        auto start = now();
+        for (int t=1; t<=numOfSteps; t++) {
+            for (size_t i=0; i<numOfParams; i++) opts[i].update(t, weights[i], dWeights[i]);
+        }
+        report("AdamOptimizer (per-parameter)", chrono::duration<double>(now() - start).count());
+    }
+    for (int numOfThreads : {1, (int)thread::hardware_concurrency()}) {
+        FlatAdamOptimizer opt(numOfParams);
+        opt.setNumOfThreads(numOfThreads);
+        auto start = now();
+        for (int t=1; t<=numOfSteps; t++) opt.step(weights.data(), dWeights.data());
+        report("FlatAdamOptimizer (" + to_string(numOfThreads) + " threads)", chrono::duration<double>(now() - start).count());
+    }
+    for (int numOfThreads : {1, (int)thread::hardware_concurrency()}) {
+        FlatSGDOptimizer opt(numOfParams);
+        opt.setNumOfThreads(numOfThreads);
+        auto start = now();
+        for (int t=1; t<=numOfSteps; t++) opt.step(weights.data(), dWeights.data());
+        report("FlatSGDOptimizer (" + to_string(numOfThreads) + " threads)", chrono::duration<double>(now() - start).count());
+    }
+}
+
+/**
+ * Convergence benchmark suite
+ *
+ * every optimizer runs on every synthetic objective until the gradient norm
+ * drops below a tolerance, recording steps-to-tolerance, wall time per step
+ * (optimizer only) and optimizer state bytes per parameter.
+ */
+struct Objective {
+    string name;
+    vector<float> init;
+    float sgdLearningRate;
+    float adamLearningRate;
+    // returns the loss and writes the gradient
+    function<double(const vector<float> &, vector<float> &)> lossAndGradient;
+};
+
+// 0.5 * sum(lambda_i * (x_i - 1)^2), lambda log-spaced in [1, conditionNumber]
+Objective getIllConditionedQuadratic(size_t numOfDims, double conditionNumber) {
+    auto lambdas = make_shared<vector<double>>(numOfDims);
+    for (size_t i=0; i<numOfDims; i++) {
+        (*lambdas)[i] = pow(conditionNumber, (double)i / max<size_t>(1, numOfDims - 1));
+    }
+    Objective objective;
+    objective.name = "quadratic_d" + to_string(numOfDims) + "_k" + to_string((int)conditionNumber);
+    objective.init = vector<float>(numOfDims, 0);
+    objective.sgdLearningRate = 1.0 / conditionNumber;
+    objective.adamLearningRate = 0.01;
+    objective.lossAndGradient = [lambdas](const vector<float> &x, vector<float> &grad) {
+        double loss = 0;
+        for (size_t i=0; i<x.size(); i++) {
+            double diff = x[i] - 1;
+            loss += 0.5 * (*lambdas)[i] * diff * diff;
+            grad[i] = (*lambdas)[i] * diff;
+        }
+        return loss;
+    };
+    return objective;
+}
+
+// sum(100 * (x_{i+1} - x_i^2)^2 + (1 - x_i)^2)
+Objective getRosenbrock(size_t numOfDims) {
+    Objective objective;
+    objective.name = "rosenbrock_d" + to_string(numOfDims);
+    objective.init = vector<float>(numOfDims, -1.2f);
+    objective.sgdLearningRate = 1e-4;
+    objective.adamLearningRate = 0.01;
+    objective.lossAndGradient = [](const vector<float> &x, vector<float> &grad) {
+        double loss = 0;
+        fill(grad.begin(), grad.end(), 0);
+        for (size_t i=0; i+1<x.size(); i++) {
+            double a = x[i+1] - (double)x[i] * x[i];
+            double b = 1 - x[i];
+            loss += 100 * a * a + b * b;
+            grad[i] += -400 * a * x[i] - 2 * b;
+            grad[i+1] += 200 * a;
+        }
+        return loss;
+    };
+    return objective;
+}
+
+// mean log-loss of a linear model on generated, linearly separable-ish data
+Objective getLogisticLoss(size_t numOfSamples, size_t numOfDims) {
+    auto xs = make_shared<Matrix<float>>(numOfSamples, numOfDims);
+    auto ys = make_shared<vector<float>>(numOfSamples);
+    vector<float> trueWeights(numOfDims);
+    for (auto &w : trueWeights) w = 2 * ((float)rand() / RAND_MAX) - 1;
+    for (size_t n=0; n<numOfSamples; n++) {
+        double z = 0;
+        for (size_t i=0; i<numOfDims; i++) {
+            float x = 2 * ((float)rand() / RAND_MAX) - 1;
+            (*xs)(n, i) = x;
+            z += trueWeights[i] * x;
+        }
+        double noise = 0.5 * (2 * ((double)rand() / RAND_MAX) - 1);
+        (*ys)[n] = (z + noise > 0) ? 1 : 0;
+    }
+
+    Objective objective;
+    objective.name = "logistic_n" + to_string(numOfSamples) + "_d" + to_string(numOfDims);
+    objective.init = vector<float>(numOfDims, 0);
+    objective.sgdLearningRate = 0.5;
+    objective.adamLearningRate = 0.05;
+    objective.lossAndGradient = [xs, ys, numOfSamples, numOfDims](const vector<float> &w, vector<float> &grad) {
+        double loss = 0;
+        fill(grad.begin(), grad.end(), 0);
+        for (size_t n=0; n<numOfSamples; n++) {
+            const float *x = xs->row(n);
+            double z = 0;
+            for (size_t i=0; i<numOfDims; i++) z += w[i] * x[i];
+            double p = 1.0 / (1.0 + exp(-z));
+            double y = (*ys)[n];
+            loss -= y * log(max(p, 1e-12)) + (1 - y) * log(max(1 - p, 1e-12));
+            for (size_t i=0; i<numOfDims; i++) grad[i] += (p - y) * x[i] / numOfSamples;
+        }
+        return loss / numOfSamples;
+    };
+    return objective;
+}
+
+// a stepper applies one update of some optimizer to the whole parameter vector
+struct Stepper {
+    function<void(vector<float> &, const vector<float> &)> step;
+    size_t stateBytes;
+};
+
+struct OptimizerFactory {
+    string name;
+    function<Stepper(size_t numOfParams, const Objective &)> create;
+};
+
+vector<OptimizerFactory> getOptimizerFactories() {
+    return {
+        {"SGDOptimizer", [](size_t numOfParams, const Objective &objective) {
+            auto opts = make_shared<vector<SGDOptimizer>>(numOfParams, SGDOptimizer(objective.sgdLearningRate));
+            auto t = make_shared<int>(0);
+            return Stepper{[opts, t](vector<float> &w, const vector<float> &g) {
+                (*t)++;
+                for (size_t i=0; i<w.size(); i++) (*opts)[i].update(*t, w[i], g[i]);
+            }, numOfParams * sizeof(SGDOptimizer)};
+        }},
+        {"AdamOptimizer", [](size_t numOfParams, const Objective &objective) {
+            auto opts = make_shared<vector<AdamOptimizer>>(numOfParams, AdamOptimizer(objective.adamLearningRate));
+            auto t = make_shared<int>(0);
+            return Stepper{[opts, t](vector<float> &w, const vector<float> &g) {
+                (*t)++;
+                for (size_t i=0; i<w.size(); i++) (*opts)[i].update(*t, w[i], g[i]);
+            }, numOfParams * sizeof(AdamOptimizer)};
+        }},
+        {"FlatSGDOptimizer", [](size_t numOfParams, const Objective &objective) {
+            auto opt = make_shared<FlatSGDOptimizer>(numOfParams, objective.sgdLearningRate);
+            return Stepper{[opt](vector<float> &w, const vector<float> &g) {
+                opt->step(w.data(), g.data());
+            }, opt->getStateBytes()};
+        }},
+        {"FlatAdamOptimizer", [](size_t numOfParams, const Objective &objective) {
+            auto opt = make_shared<FlatAdamOptimizer>(numOfParams, objective.adamLearningRate);
+            return Stepper{[opt](vector<float> &w, const vector<float> &g) {
+                opt->step(w.data(), g.data());
+            }, opt->getStateBytes()};
+        }},
+        {"SparseAdamOptimizer", [](size_t numOfParams, const Objective &objective) {
+            auto opt = make_shared<SparseAdamOptimizer>(numOfParams, objective.adamLearningRate);
+            auto grads = make_shared<vector<pair<uint32_t, float>>>(numOfParams);
+            return Stepper{[opt, grads](vector<float> &w, const vector<float> &g) {
+                for (size_t i=0; i<g.size(); i++) (*grads)[i] = {(uint32_t)i, g[i]};
+                opt->step(w.data(), *grads);
+            }, opt->getStateBytes()};
+        }},
+    };
+}
+
+void runBenchmarkSuite(string outputPath, double tolerance, int maxSteps) {
+    vector<Objective> objectives = {
+        getIllConditionedQuadratic(1000, 100),
+        getIllConditionedQuadratic(1000, 1000),
+        getRosenbrock(100),
+        getLogisticLoss(2000, 50),
+    };
+
+    ofstream file(outputPath);
+    file << "[\n";
+    bool isFirst = true;
+    for (auto &objective : objectives) {
+        for (auto &factory : getOptimizerFactories()) {
+            size_t numOfParams = objective.init.size();
+            vector<float> weights = objective.init;
+            vector<float> grads(numOfParams);
+            Stepper stepper = factory.create(numOfParams, objective);
+
+            int steps = 0;
+            bool converged = false;
+            double loss = 0, stepSeconds = 0;
+            while (steps < maxSteps) {
+                loss = objective.lossAndGradient(weights, grads);
+                double gradNorm = 0;
+                for (auto g : grads) gradNorm += (double)g * g;
+                if (!isfinite(loss)) break;
+                if (sqrt(gradNorm) < tolerance) {
+                    converged = true;
+                    break;
+                }
+                auto start = chrono::steady_clock::now();
+                stepper.step(weights, grads);
+                stepSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                steps++;
+            }
+
+            double nsPerStep = (steps > 0) ? stepSeconds / steps * 1e9 : 0;
+            double bytesPerParam = (double)stepper.stateBytes / numOfParams;
+            cout << objective.name << " / " << factory.name
+                << ": steps=" << steps << (converged ? "" : " (not converged)")
+                << ", loss=" << loss
+                << ", ns/step=" << nsPerStep
+                << ", bytes/param=" << bytesPerParam << endl;
+
+            file << (isFirst ? "" : ",\n")
+                << "  {\"objective\": \"" << objective.name << "\""
+                << ", \"optimizer\": \"" << factory.name << "\""
+                << ", \"numOfParams\": " << numOfParams
+                << ", \"converged\": " << (converged ? "true" : "false")
+                << ", \"stepsToTolerance\": " << steps
+                << ", \"finalLoss\": " << (isfinite(loss) ? loss : -1)
+                << ", \"nsPerStep\": " << nsPerStep
+                << ", \"stateBytesPerParam\": " << bytesPerParam << "}";
+            isFirst = false;
+        }
+    }
+    file << "\n]\n";
+    cout << "results written to " << outputPath << endl;
+}
+
 float getLoss(float x) {
     return x*x - 2*x + 1;
 }
@@ -80,7 +604,31 @@ float getGradient(float x) {
     return 2*x - 2;
 }
 
-int main() {
+/**
+ * usage: ./main                              (1-D demo)
+ *        ./main bench [numOfParams] [steps]  (throughput benchmark)
+ *        ./main sparse [nnz] [steps]         (sparse vs. dense Adam per-step cost)
+ *        ./main suite [results.json]         (convergence benchmark suite)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        size_t numOfParams = (argc > 2) ? stoul(argv[2]) : 1 << 22;
+        int numOfSteps = (argc > 3) ? stoi(argv[3]) : 20;
+        benchmarkThroughput(numOfParams, numOfSteps);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "sparse") {
+        size_t numOfNonzeros = (argc > 2) ? stoul(argv[2]) : 4096;
+        int numOfSteps = (argc > 3) ? stoi(argv[3]) : 50;
+        benchmarkSparse(numOfNonzeros, numOfSteps);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "suite") {
+        string outputPath = (argc > 2) ? argv[2] : "optimizer_bench.json";
+        runBenchmarkSuite(outputPath, 1e-3, 20000);
+        return 0;
+    }
+
     float weight = 0;
     int t = 1;
     AdamOptimizer opt(0.01);
@@ -8,16 +8,55 @@ activation: 0/1
 2. update weights
 3. make predictions
 
+trainStreaming runs the same updates over rows streamed from a binary,
+columnar or CSV file (../common/streaming.h), for train sets that do not fit
+in memory.
+
+online mode:
+one trainer thread applies updates from an event stream (stdin, or a
+generated stand-in) and publishes immutable weight snapshots by swapping an
+atomic pointer. Reader threads predict on the current snapshot without locks
+and announce quiescent states between predictions, old snapshots are freed
+once every reader has passed one (QSBR-style RCU).
+
+multiclass:
+AveragedMulticlassPerceptron works on sparse binary features (the indices of
+the active ones). Weights are stored feature-major, so an example only touches
+numOfActive x numOfClasses weights, and averaging is lazy: every update also
+adds t * delta to an accumulator, and the average is w - accumulator / t at
+the end (timestamp trick), instead of summing all weights after each example.
+BitPackedScorer quantizes the averaged weights to 8 bit planes per class and
+scores a bit-packed example with AND + popcount over 64-feature words. Only
+the words that hold an active feature are visited, and the planes of a word
+are stored together, so the cost is O(active words x classes x 8).
+
 */
 
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_set>
+#include <functional>
+
+#include "../common/matrix.h"
+#include "../common/streaming.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
+#include "../common/perf.h"
 
 using namespace std;
 
 
-double predict(vector<double> data, const vector<double> &weights) {
+double predict(const double *data, const vector<double> &weights) {
     double z = weights[0];
     for (int i=1; i<weights.size(); i++) {
         z += weights[i] * data[i-1];
@@ -26,14 +65,16 @@ double predict(vector<double> data, const vector<double> &weights) {
 }
 
 vector<double> train(
-    const vector<vector<double>> &trainSet, const double lr, const int numOfEpochs) {
+    const Dataset &trainSet, const double lr, const int numOfEpochs, bool verbose = true) {
     
-    int numOfWeights = 1 + (trainSet[0].size() - 1);
+    int numOfWeights = 1 + trainSet.numOfFeatures();
     vector<double> weights(numOfWeights, 0);
     for (int e=0; e<numOfEpochs; e++) {
+        PERF_COUNT("perceptron.samples", trainSet.size());
         double sumOfError = 0;
-        for (auto data : trainSet) {
-            double label = data[data.size() - 1];
+        for (int r=0; r<trainSet.size(); r++) {
+            const double *data = trainSet.row(r);
+            double label = trainSet.labels[r];
             double pred = predict(data, weights);
             sumOfError += pow(label - pred, 2);
             
@@ -43,15 +84,505 @@ vector<double> train(
                 weights[i] = weights[i] - lr * (pred - label) * data[i-1];
             }
         }
-        cout << "epoch=" << e << ", sumOfError=" << sumOfError << endl;
+        if (verbose) cout << "epoch=" << e << ", sumOfError=" << sumOfError << endl;
     }
     
     return weights;
 }
 
-int main() {
+vector<double> trainStreaming(
+    const string &path, const double lr, const int numOfEpochs,
+    size_t chunkRows = 1 << 16, size_t shuffleWindow = 4096) {
+
+    RowStream stream(path, chunkRows, shuffleWindow);
+    int numOfWeights = stream.getNumOfCols();
+    vector<double> weights(numOfWeights, 0);
+    for (int e=0; e<numOfEpochs; e++) {
+        double sumOfError = 0;
+        stream.forEachRow([&](const double *data) {
+            double label = data[numOfWeights - 1];
+            double z = weights[0];
+            for (int i=1; i<numOfWeights; i++) z += weights[i] * data[i-1];
+            double pred = (z >= 0.0) ? 1 : 0;
+            sumOfError += pow(label - pred, 2);
+
+            weights[0] = weights[0] - lr * (pred - label);
+            for (int i=1; i<numOfWeights; i++) {
+                weights[i] = weights[i] - lr * (pred - label) * data[i-1];
+            }
+        }, e);
+        cout << "epoch=" << e << ", sumOfError=" << sumOfError << endl;
+    }
+
+    return weights;
+}
+
+struct ModelSnapshot {
+    uint64_t version;
+    chrono::steady_clock::time_point publishedAt;
+    vector<double> weights;
+};
+
+class SnapshotPublisher {
+public:
+    SnapshotPublisher(int numOfReaders, const vector<double> &weights) {
+        mNumOfReaders = numOfReaders;
+        mReaderEpochs.reset(new ReaderEpoch[numOfReaders]);
+        mCurrent.store(new ModelSnapshot{0, chrono::steady_clock::now(), weights});
+    }
+
+    ~SnapshotPublisher() {
+        delete mCurrent.load();
+        for (auto &item : mRetired) delete item.second;
+    }
+
+    // readers: the snapshot stays valid until the next quiescent() of this reader
+    const ModelSnapshot *acquire() const { return mCurrent.load(); }
+    void quiescent(int readerIdx) { mReaderEpochs[readerIdx].value.store(mEpoch.load()); }
+    // a reader that stops reading must go offline, or nothing can be reclaimed
+    void goOffline(int readerIdx) { mReaderEpochs[readerIdx].value.store(UINT64_MAX); }
+
+    uint64_t getLatestVersion() const { return mLatestVersion.load(memory_order_relaxed); }
+    uint64_t getNumOfReclaimed() const { return mNumOfReclaimed; }
+
+    // writer only
+    void publish(const vector<double> &weights) {
+        uint64_t version = mLatestVersion.load(memory_order_relaxed) + 1;
+        // stored before the snapshot is visible, so a reader that acquired
+        // version v never sees getLatestVersion() < v
+        mLatestVersion.store(version, memory_order_relaxed);
+        const ModelSnapshot *old = mCurrent.exchange(new ModelSnapshot{version, chrono::steady_clock::now(), weights});
+        // readers that announce this epoch or later can no longer hold old
+        uint64_t epoch = mEpoch.fetch_add(1) + 1;
+        mRetired.push_back({epoch, old});
+        reclaim();
+    }
+
+private:
+    struct alignas(64) ReaderEpoch {
+        atomic<uint64_t> value{0};
+    };
+
+    int mNumOfReaders;
+    atomic<const ModelSnapshot *> mCurrent;
+    atomic<uint64_t> mEpoch{0};
+    atomic<uint64_t> mLatestVersion{0};
+    unique_ptr<ReaderEpoch[]> mReaderEpochs;
+    vector<pair<uint64_t, const ModelSnapshot *>> mRetired;
+    uint64_t mNumOfReclaimed = 0;
+
+    void reclaim() {
+        uint64_t minEpoch = UINT64_MAX;
+        for (int r=0; r<mNumOfReaders; r++) minEpoch = min(minEpoch, mReaderEpochs[r].value.load());
+        size_t numOfFreed = 0;
+        while (numOfFreed < mRetired.size() && mRetired[numOfFreed].first <= minEpoch) {
+            delete mRetired[numOfFreed].second;
+            numOfFreed++;
+        }
+        mRetired.erase(mRetired.begin(), mRetired.begin() + numOfFreed);
+        mNumOfReclaimed += numOfFreed;
+    }
+};
+
+/**
+ * trains from an event stream while numOfReaders threads serve predictions
+ *
+ * events are "x1,...,xd,label" lines from stdin, or generated from a fixed
+ * linear rule when useStdin is false (numOfEvents of them)
+ */
+void runOnline(int numOfInputDims, int numOfReaders, int publishEvery, bool useStdin, long numOfEvents) {
+    vector<double> weights(numOfInputDims + 1, 0);
+    SnapshotPublisher publisher(numOfReaders, weights);
+    atomic<bool> isDone{false};
+
+    struct alignas(64) ReaderStats {
+        uint64_t numOfPredictions = 0;
+        uint64_t sumOfStaleness = 0, maxStaleness = 0;
+        double sumOfAgeUs = 0;
+        uint64_t numOfAgeSamples = 0;
+        double numOfPositives = 0;
+    };
+    vector<ReaderStats> readerStats(numOfReaders);
+
+    auto reader = [&](int r) {
+        ReaderStats &stats = readerStats[r];
+        mt19937 rng(r);
+        uniform_real_distribution<double> uniform(-1, 1);
+        vector<double> query(numOfInputDims);
+        while (!isDone.load(memory_order_relaxed)) {
+            for (auto &x : query) x = uniform(rng);
+            const ModelSnapshot *snapshot = publisher.acquire();
+            stats.numOfPositives += predict(query.data(), snapshot->weights);
+            uint64_t staleness = publisher.getLatestVersion() - snapshot->version;
+            stats.sumOfStaleness += staleness;
+            stats.maxStaleness = max(stats.maxStaleness, staleness);
+            // reading the clock on every prediction would dominate
+            if ((stats.numOfPredictions & 1023) == 0) {
+                stats.sumOfAgeUs += chrono::duration<double, micro>(chrono::steady_clock::now() - snapshot->publishedAt).count();
+                stats.numOfAgeSamples++;
+            }
+            stats.numOfPredictions++;
+            publisher.quiescent(r);
+        }
+        publisher.goOffline(r);
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> readers;
+    for (int r=0; r<numOfReaders; r++) readers.emplace_back(reader, r);
+
+    // trainer
+    const double lr = 0.1;
+    uint64_t numOfUpdates = 0;
+    double sumOfError = 0;
+    vector<double> data(numOfInputDims + 1);
+    mt19937 rng(1234);
+    uniform_real_distribution<double> uniform(-1, 1);
+    string line;
+    while (true) {
+        if (useStdin) {
+            if (!getline(cin, line)) break;
+            stringstream lineStream(line);
+            string bit;
+            int c = 0;
+            while (c <= numOfInputDims && getline(lineStream, bit, ',')) data[c++] = stod(bit);
+            if (c <= numOfInputDims) continue;
+        } else {
+            if ((long)numOfUpdates >= numOfEvents) break;
+            // stand-in stream: label = (x0 - 0.5 * x1 + 0.2 > 0)
+            for (int i=0; i<numOfInputDims; i++) data[i] = uniform(rng);
+            data[numOfInputDims] = (data[0] - 0.5 * data[1 % numOfInputDims] + 0.2 > 0) ? 1 : 0;
+        }
+
+        double label = data[numOfInputDims];
+        double pred = predict(data.data(), weights);
+        sumOfError += pow(label - pred, 2);
+        weights[0] = weights[0] - lr * (pred - label);
+        for (int i=1; i<weights.size(); i++) {
+            weights[i] = weights[i] - lr * (pred - label) * data[i-1];
+        }
+        numOfUpdates++;
+        if (numOfUpdates % publishEvery == 0) publisher.publish(weights);
+    }
+    publisher.publish(weights);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    isDone.store(true);
+    for (auto &r : readers) r.join();
+    double servingSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ReaderStats total;
+    for (auto &stats : readerStats) {
+        total.numOfPredictions += stats.numOfPredictions;
+        total.sumOfStaleness += stats.sumOfStaleness;
+        total.maxStaleness = max(total.maxStaleness, stats.maxStaleness);
+        total.sumOfAgeUs += stats.sumOfAgeUs;
+        total.numOfAgeSamples += stats.numOfAgeSamples;
+    }
+    cout << "updates: " << numOfUpdates << ", updates/sec: " << numOfUpdates / seconds
+        << ", sumOfError: " << sumOfError << endl;
+    cout << "snapshots published: " << publisher.getLatestVersion()
+        << ", reclaimed: " << publisher.getNumOfReclaimed() << endl;
+    cout << "readers: " << numOfReaders << ", predictions: " << total.numOfPredictions
+        << ", predictions/sec: " << total.numOfPredictions / servingSeconds << endl;
+    cout << "staleness (versions behind): mean "
+        << (total.numOfPredictions ? (double)total.sumOfStaleness / total.numOfPredictions : 0)
+        << ", max " << total.maxStaleness
+        << "; mean snapshot age: " << (total.numOfAgeSamples ? total.sumOfAgeUs / total.numOfAgeSamples : 0) << " us" << endl;
+    cout << "weights:" << endl;
+    for (auto val : weights) cout << val << endl;
+}
+
+struct SparseBinaryExample {
+    vector<uint32_t> features; // indices of the active features
+    int label;
+};
+
+class AveragedMulticlassPerceptron {
+public:
+    AveragedMulticlassPerceptron(size_t numOfFeatures, int numOfClasses) {
+        mNumOfFeatures = numOfFeatures;
+        mNumOfClasses = numOfClasses;
+        mWeights = vector<float>(numOfFeatures * numOfClasses, 0);
+        mAccumulators = vector<double>(numOfFeatures * numOfClasses, 0);
+        mBiases = vector<float>(numOfClasses, 0);
+        mBiasAccumulators = vector<double>(numOfClasses, 0);
+    }
+
+    int getNumOfClasses() const { return mNumOfClasses; }
+    size_t getNumOfFeatures() const { return mNumOfFeatures; }
+
+    // scores[c] for every class, O(numOfActive * numOfClasses)
+    void getScores(const vector<uint32_t> &features, vector<float> &scores) const {
+        scores = mBiases;
+        for (uint32_t f : features) {
+            const float *w = &mWeights[(size_t)f * mNumOfClasses];
+            for (int c=0; c<mNumOfClasses; c++) scores[c] += w[c];
+        }
+    }
+
+    int predict(const vector<uint32_t> &features) const {
+        vector<float> scores;
+        getScores(features, scores);
+        return max_element(scores.begin(), scores.end()) - scores.begin();
+    }
+
+    // one online step, returns whether the example was misclassified
+    bool update(const SparseBinaryExample &example) {
+        mT++;
+        int pred = predict(example.features);
+        if (pred == example.label) return false;
+
+        addToClass(example.features, example.label, 1);
+        addToClass(example.features, pred, -1);
+        return true;
+    }
+
+    void train(const vector<SparseBinaryExample> &trainSet, int numOfEpochs) {
+        for (int e=0; e<numOfEpochs; e++) {
+            int numOfErrors = 0;
+            for (const auto &example : trainSet) numOfErrors += update(example);
+            cout << "epoch=" << e << ", numOfErrors=" << numOfErrors << endl;
+        }
+    }
+
+    // w_avg = w - accumulator / t, the model stays usable for further training
+    AveragedMulticlassPerceptron getAveraged() const {
+        AveragedMulticlassPerceptron averaged = *this;
+        double invT = (mT > 0) ? 1.0 / mT : 0;
+        for (size_t i=0; i<mWeights.size(); i++) averaged.mWeights[i] -= mAccumulators[i] * invT;
+        for (int c=0; c<mNumOfClasses; c++) averaged.mBiases[c] -= mBiasAccumulators[c] * invT;
+        return averaged;
+    }
+
+    float getWeight(size_t feature, int classIdx) const { return mWeights[feature * mNumOfClasses + classIdx]; }
+    float getBias(int classIdx) const { return mBiases[classIdx]; }
+
+private:
+    size_t mNumOfFeatures;
+    int mNumOfClasses;
+    vector<float> mWeights;      // [feature * numOfClasses + class]
+    // sum of t * delta, double: t * delta is no longer exact in float once t > 2^24
+    vector<double> mAccumulators;
+    vector<float> mBiases;
+    vector<double> mBiasAccumulators;
+    uint64_t mT = 0;
+
+    void addToClass(const vector<uint32_t> &features, int classIdx, float delta) {
+        double timedDelta = (double)delta * mT;
+        for (uint32_t f : features) {
+            size_t i = (size_t)f * mNumOfClasses + classIdx;
+            mWeights[i] += delta;
+            mAccumulators[i] += timedDelta;
+        }
+        mBiases[classIdx] += delta;
+        mBiasAccumulators[classIdx] += timedDelta;
+    }
+};
+
+/**
+ * int8 weights of every class as 8 bit planes over the feature words,
+ * score_c = scale * (sum_b 2^b * popcount(x & plane_b) - 256 * popcount(x & plane_7)) + bias_c
+ *
+ * the planes are word-major, the 8 planes of all classes for one word are
+ * adjacent, so an example only reads the words it has active features in
+ */
+class BitPackedScorer {
+public:
+    BitPackedScorer(const AveragedMulticlassPerceptron &model) {
+        mNumOfClasses = model.getNumOfClasses();
+        mNumOfWords = (model.getNumOfFeatures() + 63) / 64;
+        mPlanes = vector<uint64_t>(mNumOfWords * mNumOfClasses * 8, 0);
+        mBiases = vector<float>(mNumOfClasses);
+
+        // one scale for all classes keeps the argmax comparable
+        float maxAbs = 0;
+        for (size_t f=0; f<model.getNumOfFeatures(); f++) {
+            for (int c=0; c<mNumOfClasses; c++) maxAbs = max(maxAbs, fabs(model.getWeight(f, c)));
+        }
+        mScale = (maxAbs > 0) ? maxAbs / 127 : 1;
+
+        for (int c=0; c<mNumOfClasses; c++) {
+            mBiases[c] = model.getBias(c);
+            for (size_t f=0; f<model.getNumOfFeatures(); f++) {
+                int8_t q = (int8_t)lround(model.getWeight(f, c) / mScale);
+                uint8_t bits = (uint8_t)q;
+                for (int b=0; b<8; b++) {
+                    if (bits & (1 << b)) getPlanes(f / 64, c)[b] |= uint64_t(1) << (f % 64);
+                }
+            }
+        }
+    }
+
+    size_t getNumOfWords() const { return mNumOfWords; }
+
+    // (word, bits) of the words holding active features, by increasing word
+    void pack(const vector<uint32_t> &features, vector<pair<uint32_t, uint64_t>> &packed) const {
+        packed.clear();
+        for (uint32_t f : features) packed.push_back({f / 64, uint64_t(1) << (f % 64)});
+        sort(packed.begin(), packed.end());
+        size_t numOfWords = 0;
+        for (size_t k=0; k<packed.size(); k++) {
+            if (numOfWords > 0 && packed[numOfWords-1].first == packed[k].first) {
+                packed[numOfWords-1].second |= packed[k].second;
+            } else {
+                packed[numOfWords++] = packed[k];
+            }
+        }
+        packed.resize(numOfWords);
+    }
+
+    int predict(const vector<pair<uint32_t, uint64_t>> &packed) const {
+        vector<int64_t> sums(mNumOfClasses, 0);
+        for (auto &word : packed) {
+            for (int c=0; c<mNumOfClasses; c++) {
+                const uint64_t *planes = getPlanes(word.first, c);
+                int64_t sum = 0;
+                for (int b=0; b<7; b++) sum += (int64_t)__builtin_popcountll(word.second & planes[b]) << b;
+                // two's complement: the top plane weighs -128
+                sum -= 128 * (int64_t)__builtin_popcountll(word.second & planes[7]);
+                sums[c] += sum;
+            }
+        }
+
+        int best = 0;
+        float bestScore = -INFINITY;
+        for (int c=0; c<mNumOfClasses; c++) {
+            float score = mScale * sums[c] + mBiases[c];
+            if (score > bestScore) {
+                bestScore = score;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+private:
+    int mNumOfClasses;
+    size_t mNumOfWords;
+    float mScale;
+    vector<uint64_t> mPlanes; // [(word * numOfClasses + class) * 8 + bit]
+    vector<float> mBiases;
+
+    uint64_t *getPlanes(size_t w, int c) { return &mPlanes[(w * mNumOfClasses + c) * 8]; }
+    const uint64_t *getPlanes(size_t w, int c) const { return &mPlanes[(w * mNumOfClasses + c) * 8]; }
+};
+
+// every class owns a random prototype set of features, examples mix prototype and noise features
+vector<SparseBinaryExample> getSyntheticMulticlassDataset(
+    int numOfExamples, int numOfClasses, size_t numOfFeatures, int numOfActive, unsigned seed) {
+
+    mt19937 rng(seed);
+    uniform_int_distribution<size_t> anyFeature(0, numOfFeatures - 1);
+    vector<vector<uint32_t>> prototypes(numOfClasses);
+    mt19937 prototypeRng(7);
+    for (auto &prototype : prototypes) {
+        for (int i=0; i<4 * numOfActive; i++) prototype.push_back(anyFeature(prototypeRng));
+    }
+
+    vector<SparseBinaryExample> dataset(numOfExamples);
+    for (auto &example : dataset) {
+        example.label = rng() % numOfClasses;
+        unordered_set<uint32_t> active;
+        const auto &prototype = prototypes[example.label];
+        while ((int)active.size() < numOfActive) {
+            active.insert((rng() % 4 == 0) ? anyFeature(rng) : prototype[rng() % prototype.size()]);
+        }
+        example.features.assign(active.begin(), active.end());
+        sort(example.features.begin(), example.features.end());
+    }
+    return dataset;
+}
+
+void benchmarkMulticlass(int numOfClasses, size_t numOfFeatures, int numOfActive) {
+    vector<SparseBinaryExample> trainSet = getSyntheticMulticlassDataset(20000, numOfClasses, numOfFeatures, numOfActive, 1);
+    vector<SparseBinaryExample> testSet = getSyntheticMulticlassDataset(5000, numOfClasses, numOfFeatures, numOfActive, 2);
+    cout << "classes: " << numOfClasses << ", features: " << numOfFeatures << ", active: " << numOfActive << endl;
+
+    AveragedMulticlassPerceptron model(numOfFeatures, numOfClasses);
+    auto start = chrono::steady_clock::now();
+    model.train(trainSet, 5);
+    double trainSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "train: " << 5 * trainSet.size() / trainSeconds << " examples/sec" << endl;
+
+    AveragedMulticlassPerceptron averaged = model.getAveraged();
+    BitPackedScorer scorer(averaged);
+
+    auto evaluate = [&](string name, function<int(const SparseBinaryExample &)> classify, size_t numOfExamples) {
+        numOfExamples = min(numOfExamples, testSet.size());
+        int numOfCorrect = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t i=0; i<numOfExamples; i++) numOfCorrect += (classify(testSet[i]) == testSet[i].label);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << name << ": accuracy " << (double)numOfCorrect / numOfExamples
+            << ", " << numOfExamples / seconds << " examples/sec" << endl;
+    };
+    evaluate("last weights (sparse)", [&](const SparseBinaryExample &example) {
+        return model.predict(example.features);
+    }, testSet.size());
+    evaluate("averaged (sparse)", [&](const SparseBinaryExample &example) {
+        return averaged.predict(example.features);
+    }, testSet.size());
+    vector<pair<uint32_t, uint64_t>> packed;
+    evaluate("averaged (bit-packed, int8)", [&](const SparseBinaryExample &example) {
+        scorer.pack(example.features, packed);
+        return scorer.predict(packed);
+    }, testSet.size());
+    // reference: dense one-hot row against every class, O(features * classes)
+    vector<float> dense(numOfFeatures);
+    evaluate("averaged (dense)", [&](const SparseBinaryExample &example) {
+        fill(dense.begin(), dense.end(), 0);
+        for (uint32_t f : example.features) dense[f] = 1;
+        int best = 0;
+        float bestScore = -INFINITY;
+        for (int c=0; c<numOfClasses; c++) {
+            float score = averaged.getBias(c);
+            for (size_t f=0; f<numOfFeatures; f++) score += averaged.getWeight(f, c) * dense[f];
+            if (score > bestScore) {
+                bestScore = score;
+                best = c;
+            }
+        }
+        return best;
+    }, 500);
+}
+
+// linearly separable: the label is the sign of a noiseless linear target
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("Perceptron");
+    const int numOfEpochs = 5;
+    for (int numOfInputDims : {2, 32}) {
+        Dataset trainSet = getSyntheticLinear(numOfRows, numOfInputDims, 0, 7);
+        for (auto &label : trainSet.labels) label = (label >= 0) ? 1 : 0;
+
+        vector<double> weights;
+        double seconds = timeSeconds([&]() { weights = train(trainSet, 0.01, numOfEpochs, false); });
+        size_t numOfCorrect = 0;
+        for (size_t r=0; r<trainSet.size(); r++) {
+            numOfCorrect += (predict(trainSet.row(r), weights) == trainSet.labels[r]);
+        }
+        report.add("train_5_epochs", numOfRows, numOfInputDims, seconds,
+            {{"accuracy", (double)numOfCorrect / numOfRows}}, numOfEpochs);
+    }
+    report.write(outputPath);
+}
+
+/**
+ * usage: ./main                         (in-memory training)
+ *        ./main stream [path] [epochs]  (out-of-core training over a binary / columnar / CSV file)
+ *        ./main online [readers] [dims] [events|stdin]  (train while serving, RCU snapshots)
+ *        ./main multiclass [classes] [features] [active]  (averaged multiclass, sparse / bit-packed)
+ *        ./main suite [rows] [out.json]  (synthetic benchmark, JSON results)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
     
-    vector<vector<double>> trainSet = {
+    Dataset trainSet = Dataset::fromRows({
         {2.7810836,2.550537003,0},
         {1.465489372,2.362125076,0},
         {3.396561688,4.400293529,0},
@@ -62,8 +593,36 @@ int main() {
         {6.922596716,1.77106367,1},
         {8.675418651,-0.242068655,1},
         {7.673756466,3.508563011,1}
-    };
+    });
     
+    if (argc > 1 && string(argv[1]) == "multiclass") {
+        int numOfClasses = (argc > 2) ? stoi(argv[2]) : 200;
+        size_t numOfFeatures = (argc > 3) ? stoul(argv[3]) : 4096;
+        int numOfActive = (argc > 4) ? stoi(argv[4]) : 32;
+        benchmarkMulticlass(numOfClasses, numOfFeatures, numOfActive);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "online") {
+        int numOfReaders = (argc > 2) ? stoi(argv[2]) : 4;
+        int numOfInputDims = (argc > 3) ? stoi(argv[3]) : 2;
+        bool useStdin = (argc > 4) && string(argv[4]) == "stdin";
+        long numOfEvents = (argc > 4 && !useStdin) ? stol(argv[4]) : 2000000;
+        runOnline(numOfInputDims, numOfReaders, 1000, useStdin, numOfEvents);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "stream") {
+        string path = (argc > 2) ? argv[2] : "";
+        int numOfEpochs = (argc > 3) ? stoi(argv[3]) : 5;
+        if (path.empty()) {
+            path = "trainSet.bin";
+            writeBinaryRows(path, trainSet);
+        }
+        vector<double> weights = trainStreaming(path, 0.1, numOfEpochs);
+        cout << "weights:" << endl;
+        for (auto val : weights) cout << val << endl;
+        return 0;
+    }
+
     // vector<double> weights = {-0.1, 0.20653640140000007, -0.23418117710000003};
     double lr = 0.1;
     int numOfEpochs = 5;
@@ -73,7 +632,7 @@ int main() {
     cout << "weights:" << endl;
     for (auto val : weights) cout << val << endl;
     cout << "testing:" << endl;
-    for (auto data : trainSet) {
-        cout << predict(data, weights) << endl;
+    for (int r=0; r<trainSet.size(); r++) {
+        cout << predict(trainSet.row(r), weights) << endl;
     }
 }
\ No newline at end of file
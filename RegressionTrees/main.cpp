@@ -16,6 +16,14 @@ The Gini cost function is used which provides an indication of how pure the node
     3.3 Building a Tree
 4. Make a Prediction
 
+Presorted split search:
+every feature is sorted once per dataset. A node sweeps the sorted rows of
+each feature, skipping rows outside the node, and evaluates the gini of
+"x < value" for each distinct value from running class counts, O(rows) per
+feature instead of O(rows^2). Ties are resolved like the exhaustive scan, so
+both build the same tree. The sort is shared by every node, and by every fold
+and configuration of a cross-validation run.
+
 */
 
 #include <iostream>
@@ -25,29 +33,42 @@ The Gini cost function is used which provides an indication of how pure the node
 #include <climits>
 #include <cfloat>
 #include <algorithm>
+#include <string>
+#include <cmath>
+
+#include "../common/matrix.h"
+#include "../common/columnar.h"
+#include "../common/thread_pool.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
+#include "../common/perf.h"
+#include "../common/cv.h"
+#include "../common/model.h"
 
 using namespace std;
 
-double giniIndex(const vector<vector<vector<double>>> &groups, vector<double> classes) {
+// groups hold row indices into the dataset, rows are never copied
+double giniIndex(
+    const Dataset &dataset, const vector<vector<int>> &groups, 
+    const vector<double> &classes) {
     
     // count all samples as split point
     int numOfInstances = 0;
-    for (auto group : groups) {
+    for (const auto &group : groups) {
         numOfInstances += group.size();
     }
     
     // sum weighted Gini index for each group
     double gini = 0;
-    for (auto group : groups) {
+    for (const auto &group : groups) {
         double size = group.size();
         if (size == 0) continue; // avoid divide by zero
         
         double score = 1.0; // 1 - p_1^2 - p_2^2 - ... - - p_N^2
-        for (int classIdx : classes) {
+        for (double classIdx : classes) {
             double count = 0;
-            for (auto instance : group) {
-                double label = instance[instance.size() - 1];
-                if (label == classIdx) count++;
+            for (int instance : group) {
+                if (dataset.labels[instance] == classIdx) count++;
             }
             double p = count / size;
             score -= p * p;
@@ -58,17 +79,17 @@ double giniIndex(const vector<vector<vector<double>>> &groups, vector<double> cl
     return gini;
 }
 
-vector<vector<vector<double>>> splitGroups(
+vector<vector<int>> splitGroups(
     int featureIdx, double value, 
-    const vector<vector<double>> &dataset) {
+    const Dataset &dataset, const vector<int> &indices) {
     
-    vector<vector<double>> lefts;
-    vector<vector<double>> rights;
-    for (auto data : dataset) {
-        if (data[featureIdx] < value) {
-            lefts.push_back(data);
+    vector<int> lefts;
+    vector<int> rights;
+    for (int idx : indices) {
+        if (dataset.features(idx, featureIdx) < value) {
+            lefts.push_back(idx);
         } else {
-            rights.push_back(data);
+            rights.push_back(idx);
         }
     }
     
@@ -79,51 +100,182 @@ struct Node {
     int featureIdx;
     double featureValue;
     double gini;
-    vector<vector<vector<double>>> groups;
+    vector<vector<int>> groups;
     
     Node* left = nullptr;
     Node* right = nullptr;
     double label = -1;
 };
 
-Node* getSplit(const vector<vector<double>> &dataset) {
-    int numOfFeatures = dataset[0].size() - 1;
+// order[f] lists all rows by increasing feature f, ties by row index
+struct PresortedFeatures {
+    vector<vector<int>> order;
+};
+
+PresortedFeatures presortFeatures(const Dataset &dataset) {
+    PresortedFeatures presorted;
+    presorted.order.resize(dataset.numOfFeatures());
+    parallelFor(0, dataset.numOfFeatures(), 1, [&](size_t begin, size_t end) {
+        for (size_t f=begin; f<end; f++) {
+            vector<int> &order = presorted.order[f];
+            order.resize(dataset.size());
+            for (int i=0; i<order.size(); i++) order[i] = i;
+            stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return dataset.features(a, f) < dataset.features(b, f);
+            });
+        }
+    });
+    return presorted;
+}
+
+// same arithmetic as giniIndex on the two groups, from class counts
+double giniFromCounts(
+    const vector<double> &leftCounts, double leftSize,
+    const vector<double> &totalCounts, int numOfInstances) {
+
+    double gini = 0;
+    double rightSize = numOfInstances - leftSize;
+    for (int g=0; g<2; g++) {
+        double size = (g == 0) ? leftSize : rightSize;
+        if (size == 0) continue;
+        double score = 1.0;
+        for (size_t c=0; c<totalCounts.size(); c++) {
+            double count = (g == 0) ? leftCounts[c] : totalCounts[c] - leftCounts[c];
+            double p = count / size;
+            score -= p * p;
+        }
+        gini += (size / numOfInstances) * score;
+    }
+    return gini;
+}
+
+struct SplitCandidate {
+    double gini = DBL_MAX;
+    int featureIdx = 0;
+    int position = INT_MAX; // in the node's indices
+};
+
+SplitCandidate getBestPresortedSplit(
+    const Dataset &dataset, const vector<int> &order, int featureIdx,
+    const vector<int> &positions, const vector<int> &classes,
+    const vector<double> &totalCounts, int numOfInstances) {
+
+    SplitCandidate best;
+    best.featureIdx = featureIdx;
+    vector<double> leftCounts(totalCounts.size(), 0);
+    double leftSize = 0;
+    size_t numOfCandidates = 0;
+    size_t i = 0;
+    while (i < order.size()) {
+        if (positions[order[i]] < 0) {
+            i++;
+            continue;
+        }
+        // rows with x < value are on the left
+        double value = dataset.features(order[i], featureIdx);
+        double gini = giniFromCounts(leftCounts, leftSize, totalCounts, numOfInstances);
+        int position = INT_MAX;
+        for (; i < order.size() && dataset.features(order[i], featureIdx) == value; i++) {
+            int row = order[i];
+            if (positions[row] < 0) continue;
+            position = min(position, positions[row]);
+            leftCounts[classes[row]]++;
+            leftSize++;
+        }
+        numOfCandidates++;
+        if (gini < best.gini || (gini == best.gini && position < best.position)) {
+            best.gini = gini;
+            best.position = position;
+        }
+    }
+    PERF_COUNT("cart.splitCandidates", numOfCandidates);
+    return best;
+}
+
+Node* getPresortedSplit(
+    const Dataset &dataset, const vector<int> &indices,
+    const vector<double> &labels, const PresortedFeatures &presorted) {
+
+    // position in the node (-1 = not in the node) and class of every row
+    vector<int> positions(dataset.size(), -1);
+    vector<int> classes(dataset.size(), 0);
+    vector<double> totalCounts(labels.size(), 0);
+    for (int i=0; i<indices.size(); i++) {
+        int row = indices[i];
+        positions[row] = i;
+        classes[row] = lower_bound(labels.begin(), labels.end(), dataset.labels[row]) - labels.begin();
+        totalCounts[classes[row]]++;
+    }
+
+    // features are folded in order with a strict <, so the first best feature wins
+    SplitCandidate best = parallelReduce(0, dataset.numOfFeatures(), 1, SplitCandidate(),
+        [&](size_t begin, size_t end, SplitCandidate &partial) {
+            PERF_REGION("cart.splitSearch");
+            for (size_t f=begin; f<end; f++) {
+                SplitCandidate candidate = getBestPresortedSplit(
+                    dataset, presorted.order[f], f, positions, classes, totalCounts, indices.size());
+                if (candidate.gini < partial.gini) partial = candidate;
+            }
+        },
+        [](SplitCandidate &result, const SplitCandidate &partial) {
+            if (partial.gini < result.gini) result = partial;
+        });
+
+    Node* info = new Node;
+    info->featureIdx = best.featureIdx;
+    info->featureValue = dataset.features(indices[best.position], best.featureIdx);
+    info->gini = best.gini;
+    info->groups = splitGroups(info->featureIdx, info->featureValue, dataset, indices);
+    return info;
+}
+
+// exhaustive search, or a sweep over presorted features when given
+Node* getSplit(const Dataset &dataset, const vector<int> &indices, const PresortedFeatures *presorted = nullptr) {
+    int numOfFeatures = dataset.numOfFeatures();
     
     // get labels lists
     unordered_set<double> bucket;
-    for (auto data : dataset) {
-        double classIdx = data[numOfFeatures];
-        bucket.insert(classIdx);
+    for (int idx : indices) {
+        bucket.insert(dataset.labels[idx]);
     }
     vector<double> labels;
     for (auto label : bucket) labels.push_back(label);
     sort(labels.begin(), labels.end());
+    if (presorted != nullptr) return getPresortedSplit(dataset, indices, labels, *presorted);
     
-    // split groups by min gini
-    double minGini = DBL_MAX;
-    Node* info = new Node;
-    for (int featureIdx=0; featureIdx<numOfFeatures; featureIdx++) {
-        for (auto data : dataset) {
-            auto groups = splitGroups(featureIdx, data[featureIdx], dataset);
-            auto gini = giniIndex(groups, labels);
-            // cout << "X1 < " << data[featureIdx] << ", gini = " << gini << endl;
-            if (gini < minGini) {
-                minGini = gini;
-                info->featureIdx = featureIdx;
-                info->featureValue = data[featureIdx];
-                info->gini = gini;
-                info->groups = groups;
+    // split groups by min gini, candidate c is (feature c / n, value of row indices[c % n]).
+    // chunks are folded in order and only a strictly smaller gini wins, so the
+    // first best candidate is picked, as in a sequential scan
+    size_t numOfRows = indices.size();
+    pair<double, size_t> best = parallelReduce(0, numOfFeatures * numOfRows, 64, make_pair(DBL_MAX, (size_t)0),
+        [&](size_t begin, size_t end, pair<double, size_t> &partial) {
+            PERF_REGION("cart.splitSearch");
+            PERF_COUNT("cart.splitCandidates", end - begin);
+            for (size_t c=begin; c<end; c++) {
+                int featureIdx = c / numOfRows;
+                double value = dataset.features(indices[c % numOfRows], featureIdx);
+                auto groups = splitGroups(featureIdx, value, dataset, indices);
+                auto gini = giniIndex(dataset, groups, labels);
+                if (gini < partial.first) partial = {gini, c};
             }
-        }
-    }
+        },
+        [](pair<double, size_t> &result, const pair<double, size_t> &partial) {
+            if (partial.first < result.first) result = partial;
+        });
+
+    Node* info = new Node;
+    info->featureIdx = best.second / numOfRows;
+    info->featureValue = dataset.features(indices[best.second % numOfRows], info->featureIdx);
+    info->gini = best.first;
+    info->groups = splitGroups(info->featureIdx, info->featureValue, dataset, indices);
     return info;
 }
 
 // Create a terminal node value, and it will return most common output value
-double toTerminal(const vector<vector<double>> &group) {
+double toTerminal(const Dataset &dataset, const vector<int> &group) {
     unordered_map<double, int> counter;
-    for (auto data : group) {
-        double label = data[data.size()-1];
+    for (int idx : group) {
+        double label = dataset.labels[idx];
         if (counter.count(label) == 0) {
             counter[label] = 1;
         } else {
@@ -143,57 +295,77 @@ double toTerminal(const vector<vector<double>> &group) {
 }
 
 // Create child splits for a node or make terminal
-void split(Node* currNode, int maxDepth, int minSize, int depth) {
-    auto leftGroup = currNode->groups[0];
-    auto rightGroup = currNode->groups[1];
+void split(
+    const Dataset &dataset, Node* currNode, int maxDepth, int minSize, int depth,
+    const PresortedFeatures *presorted = nullptr) {
+
+    auto leftGroup = move(currNode->groups[0]);
+    auto rightGroup = move(currNode->groups[1]);
     currNode->groups.clear();
     
     // check for a no split
     if (leftGroup.empty() || rightGroup.empty()) {
         if (leftGroup.empty()) {
             currNode->right = new Node;
-            currNode->right->label = toTerminal(rightGroup);
+            currNode->right->label = toTerminal(dataset, rightGroup);
         } else {
             currNode->left = new Node;
-            currNode->left->label = toTerminal(leftGroup);
+            currNode->left->label = toTerminal(dataset, leftGroup);
         }
         return;
     }
     // check for max depth
     if (depth >= maxDepth) {
         currNode->left = new Node;
-        currNode->left->label = toTerminal(leftGroup);
+        currNode->left->label = toTerminal(dataset, leftGroup);
         currNode->right = new Node;
-        currNode->right->label = toTerminal(rightGroup);
+        currNode->right->label = toTerminal(dataset, rightGroup);
         return;
     }
     // process left child
     if (leftGroup.size() <= minSize) {
         currNode->left = new Node;
-        currNode->left->label = toTerminal(leftGroup);
+        currNode->left->label = toTerminal(dataset, leftGroup);
     } else {
-        currNode->left = getSplit(leftGroup);
-        split(currNode->left, maxDepth, minSize, depth+1);
+        currNode->left = getSplit(dataset, leftGroup, presorted);
+        split(dataset, currNode->left, maxDepth, minSize, depth+1, presorted);
     }
     // process right child
     if (rightGroup.size() <= minSize) {
         currNode->right = new Node;
-        currNode->right->label = toTerminal(rightGroup);
+        currNode->right->label = toTerminal(dataset, rightGroup);
     } else {
-        currNode->right = getSplit(rightGroup);
-        split(currNode->right, maxDepth, minSize, depth+1);
+        currNode->right = getSplit(dataset, rightGroup, presorted);
+        split(dataset, currNode->right, maxDepth, minSize, depth+1, presorted);
     }
 }
 
+// tree over the rows in indices only (e.g. the train folds)
 Node* buildTree(
-    const vector<vector<double>> &dataset, 
-    int maxDepth, int minSize) {
-    
-    Node* root = getSplit(dataset);
-    split(root, maxDepth, minSize, 1);
+    const Dataset &dataset, const vector<int> &indices,
+    int maxDepth, int minSize, const PresortedFeatures *presorted = nullptr) {
+
+    Node* root = getSplit(dataset, indices, presorted);
+    split(dataset, root, maxDepth, minSize, 1, presorted);
     return root;
 }
 
+Node* buildTree(
+    const Dataset &dataset, 
+    int maxDepth, int minSize, const PresortedFeatures *presorted = nullptr) {
+    
+    vector<int> indices(dataset.size());
+    for (int i=0; i<indices.size(); i++) indices[i] = i;
+    return buildTree(dataset, indices, maxDepth, minSize, presorted);
+}
+
+void deleteTree(Node* root) {
+    if (root == nullptr) return;
+    deleteTree(root->left);
+    deleteTree(root->right);
+    delete root;
+}
+
 void printTree(Node* root, int depth) {
     if (root == nullptr) return;
     
@@ -210,7 +382,7 @@ void printTree(Node* root, int depth) {
     printTree(root->right, depth+1);
 }
 
-double predict(Node* currNode, vector<double> data) {
+double predict(Node* currNode, const double *data) {
     
     if (currNode->label != -1) return currNode->label;
     
@@ -227,9 +399,439 @@ double predict(Node* currNode, vector<double> data) {
     return -1;
 }
 
-int main() {
+/**
+ * Hoeffding tree (VFDT) for labels that arrive one example at a time
+ *
+ * every leaf keeps, per class, the count and per feature a running mean /
+ * variance / min / max (Welford), so its memory does not grow with the
+ * number of examples. Every gracePeriod examples a leaf evaluates
+ * numOfThresholds thresholds between the min and max of each feature,
+ * estimating the class counts below a threshold from the per-class gaussians.
+ * It splits when the best gini beats the second best feature (and not
+ * splitting) by more than the Hoeffding bound
+ *     eps = sqrt(R^2 ln(1/delta) / (2n)),  R = 1 for gini,
+ * or when eps < tieThreshold (the candidates are equally good). Learning one
+ * example is a descent plus O(features) updates, and no leaf splits once
+ * maxNumOfLeaves is reached.
+ *
+ * The tree is made of the same Node as buildTree (leaves carry the majority
+ * label), so predict(tree.getRoot(), data) and printTree work unchanged.
+ * learn() and predict() must not run concurrently.
+ */
+class HoeffdingTree {
+
+public:
+    HoeffdingTree(
+        int numOfFeatures, double delta = 1e-6, int gracePeriod = 200,
+        double tieThreshold = 0.05, int maxNumOfLeaves = 1024, int numOfThresholds = 10);
+    ~HoeffdingTree();
+    HoeffdingTree(const HoeffdingTree &) = delete;
+    HoeffdingTree &operator=(const HoeffdingTree &) = delete;
+
+    void learn(const double *data, double label);
+    Node* getRoot() const { return mRoot; }
+    int getNumOfLeaves() const { return mLeafStats.size(); }
+    size_t getNumOfSamples() const { return mNumOfSamples; }
+
+private:
+    struct FeatureStats {
+        double mean = 0;
+        double m2 = 0;
+        double min = DBL_MAX;
+        double max = -DBL_MAX;
+    };
+    struct ClassStats {
+        double label;
+        double count = 0;
+        vector<FeatureStats> features;
+    };
+    struct LeafStats {
+        vector<ClassStats> classes;
+        size_t numOfSamplesSinceCheck = 0;
+    };
+
+    int mNumOfFeatures;
+    double mDelta;
+    int mGracePeriod;
+    double mTieThreshold;
+    int mMaxNumOfLeaves;
+    int mNumOfThresholds;
+    size_t mNumOfSamples = 0;
+    Node* mRoot;
+    unordered_map<Node*, LeafStats> mLeafStats;
+
+    void update(LeafStats &stats, const double *data, double label);
+    double getMajorityLabel(const LeafStats &stats, double defaultLabel);
+    double getFractionBelow(const ClassStats &classStats, int featureIdx, double threshold);
+    void trySplit(Node* leaf, LeafStats &stats);
+};
+
+HoeffdingTree::HoeffdingTree(
+    int numOfFeatures, double delta, int gracePeriod,
+    double tieThreshold, int maxNumOfLeaves, int numOfThresholds) {
+
+    mNumOfFeatures = numOfFeatures;
+    mDelta = delta;
+    mGracePeriod = gracePeriod;
+    mTieThreshold = tieThreshold;
+    mMaxNumOfLeaves = maxNumOfLeaves;
+    mNumOfThresholds = numOfThresholds;
+    mRoot = new Node;
+    mRoot->label = 0;
+    mLeafStats[mRoot];
+}
+
+HoeffdingTree::~HoeffdingTree() {
+    deleteTree(mRoot);
+}
+
+void HoeffdingTree::update(LeafStats &stats, const double *data, double label) {
+    ClassStats *classStats = nullptr;
+    for (auto &c : stats.classes) {
+        if (c.label == label) classStats = &c;
+    }
+    if (classStats == nullptr) {
+        stats.classes.push_back({label, 0, vector<FeatureStats>(mNumOfFeatures)});
+        classStats = &stats.classes.back();
+    }
+    classStats->count++;
+    for (int f=0; f<mNumOfFeatures; f++) {
+        FeatureStats &feature = classStats->features[f];
+        double delta = data[f] - feature.mean;
+        feature.mean += delta / classStats->count;
+        feature.m2 += delta * (data[f] - feature.mean);
+        feature.min = min(feature.min, data[f]);
+        feature.max = max(feature.max, data[f]);
+    }
+    stats.numOfSamplesSinceCheck++;
+}
+
+double HoeffdingTree::getMajorityLabel(const LeafStats &stats, double defaultLabel) {
+    double maxCount = 0;
+    for (auto &c : stats.classes) {
+        if (c.count > maxCount) {
+            maxCount = c.count;
+            defaultLabel = c.label;
+        }
+    }
+    return defaultLabel;
+}
+
+// share of the class with feature < threshold, from its gaussian
+double HoeffdingTree::getFractionBelow(const ClassStats &classStats, int featureIdx, double threshold) {
+    const FeatureStats &feature = classStats.features[featureIdx];
+    double std = sqrt(feature.m2 / classStats.count);
+    if (std == 0) return (feature.mean < threshold) ? 1 : 0;
+    return 0.5 * erfc(-(threshold - feature.mean) / (std * sqrt(2.0)));
+}
+
+// descend like predict, update the leaf, split it every gracePeriod examples
+void HoeffdingTree::learn(const double *data, double label) {
+    Node* currNode = mRoot;
+    while (currNode->label == -1) {
+        currNode = (data[currNode->featureIdx] < currNode->featureValue) ? currNode->left : currNode->right;
+    }
+    LeafStats &stats = mLeafStats[currNode];
+    update(stats, data, label);
+    currNode->label = getMajorityLabel(stats, currNode->label);
+    mNumOfSamples++;
+
+    if (stats.numOfSamplesSinceCheck >= mGracePeriod && (int)mLeafStats.size() < mMaxNumOfLeaves) {
+        stats.numOfSamplesSinceCheck = 0;
+        trySplit(currNode, stats);
+    }
+}
+
+void HoeffdingTree::trySplit(Node* leaf, LeafStats &stats) {
+    if (stats.classes.size() < 2) return; // pure leaf
+    PERF_REGION("hoeffding.splitSearch");
+
+    // same class order as the batch builder, counts of each class below a threshold
+    sort(stats.classes.begin(), stats.classes.end(),
+        [](const ClassStats &a, const ClassStats &b) { return a.label < b.label; });
+    vector<double> totalCounts;
+    double numOfSamples = 0;
+    for (auto &c : stats.classes) {
+        totalCounts.push_back(c.count);
+        numOfSamples += c.count;
+    }
+    vector<double> noSplit(totalCounts.size(), 0);
+    double currentGini = giniFromCounts(noSplit, 0, totalCounts, numOfSamples);
+
+    // best threshold of each feature
+    vector<pair<double, double>> bestOfFeature(mNumOfFeatures, {DBL_MAX, 0}); // (gini, threshold)
+    vector<double> leftCounts(totalCounts.size());
+    for (int f=0; f<mNumOfFeatures; f++) {
+        double low = DBL_MAX, high = -DBL_MAX;
+        for (auto &c : stats.classes) {
+            low = min(low, c.features[f].min);
+            high = max(high, c.features[f].max);
+        }
+        for (int t=1; t<=mNumOfThresholds && low < high; t++) {
+            double threshold = low + (high - low) * t / (mNumOfThresholds + 1);
+            double leftSize = 0;
+            for (size_t c=0; c<stats.classes.size(); c++) {
+                leftCounts[c] = stats.classes[c].count * getFractionBelow(stats.classes[c], f, threshold);
+                leftSize += leftCounts[c];
+            }
+            double gini = giniFromCounts(leftCounts, leftSize, totalCounts, numOfSamples);
+            if (gini < bestOfFeature[f].first) bestOfFeature[f] = {gini, threshold};
+        }
+    }
+    PERF_COUNT("hoeffding.splitCandidates", mNumOfFeatures * mNumOfThresholds);
+
+    int bestFeature = min_element(bestOfFeature.begin(), bestOfFeature.end()) - bestOfFeature.begin();
+    double bestGini = bestOfFeature[bestFeature].first;
+    double secondGini = currentGini;
+    for (int f=0; f<mNumOfFeatures; f++) {
+        if (f != bestFeature) secondGini = min(secondGini, bestOfFeature[f].first);
+    }
+    double epsilon = sqrt(log(1 / mDelta) / (2 * numOfSamples));
+    if (bestGini >= currentGini) return;
+    if (secondGini - bestGini <= epsilon && epsilon >= mTieThreshold) return;
+
+    // the leaf becomes an internal node, the children start from the estimated majority
+    double threshold = bestOfFeature[bestFeature].second;
+    leaf->featureIdx = bestFeature;
+    leaf->featureValue = threshold;
+    leaf->gini = bestGini;
+    double majorityLabel = leaf->label;
+    leaf->label = -1;
+    leaf->left = new Node;
+    leaf->right = new Node;
+    double maxLeft = -1, maxRight = -1;
+    leaf->left->label = leaf->right->label = majorityLabel;
+    for (auto &c : stats.classes) {
+        double fraction = getFractionBelow(c, bestFeature, threshold);
+        if (c.count * fraction > maxLeft) {
+            maxLeft = c.count * fraction;
+            leaf->left->label = c.label;
+        }
+        if (c.count * (1 - fraction) > maxRight) {
+            maxRight = c.count * (1 - fraction);
+            leaf->right->label = c.label;
+        }
+    }
+    mLeafStats.erase(leaf); // invalidates stats
+    mLeafStats[leaf->left];
+    mLeafStats[leaf->right];
+}
+
+// the exhaustive split search is O(rows^2) per node, so the train set is capped
+const size_t MAX_BENCH_TRAIN_ROWS = 2000;
+
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("RegressionTrees");
+    size_t numOfTrainRows = min(numOfRows, MAX_BENCH_TRAIN_ROWS);
+    size_t numOfTestRows = numOfRows;
+    for (int numOfDims : {2, 8}) {
+        Dataset blobs = getSyntheticBlobs(numOfTrainRows + numOfTestRows, numOfDims, 4, 4.0);
+        Dataset trainSet(numOfTrainRows, numOfDims);
+        copy(blobs.row(0), blobs.row(0) + numOfTrainRows * numOfDims, trainSet.row(0));
+        copy(blobs.labels.begin(), blobs.labels.begin() + numOfTrainRows, trainSet.labels.begin());
+
+        Node* root = nullptr;
+        double seconds = timeSeconds([&]() { root = buildTree(trainSet, 5, 10); });
+        report.add("build_depth5", numOfTrainRows, numOfDims, seconds);
+
+        Node* presortedRoot = nullptr;
+        seconds = timeSeconds([&]() {
+            PresortedFeatures presorted = presortFeatures(trainSet);
+            presortedRoot = buildTree(trainSet, 5, 10, &presorted);
+        });
+        report.add("build_presorted_depth5", numOfTrainRows, numOfDims, seconds);
+        deleteTree(presortedRoot);
+
+        int numOfCorrect = 0;
+        seconds = timeSeconds([&]() {
+            for (size_t r=numOfTrainRows; r<blobs.size(); r++) {
+                if (predict(root, blobs.row(r)) == blobs.labels[r]) numOfCorrect++;
+            }
+        });
+        report.add("predict_depth5", numOfTestRows, numOfDims, seconds,
+            {{"accuracy", (double)numOfCorrect / numOfTestRows}});
+
+        // one pass over the first numOfRows rows, tested on the rest
+        HoeffdingTree tree(numOfDims);
+        seconds = timeSeconds([&]() {
+            for (size_t r=0; r<numOfTestRows; r++) tree.learn(blobs.row(r), blobs.labels[r]);
+        });
+        numOfCorrect = 0;
+        for (size_t r=numOfTestRows; r<blobs.size(); r++) {
+            numOfCorrect += (predict(tree.getRoot(), blobs.row(r)) == blobs.labels[r]);
+        }
+        report.add("hoeffding_learn", numOfTestRows, numOfDims, seconds, {
+            {"accuracy", (double)numOfCorrect / (blobs.size() - numOfTestRows)},
+            {"leaves", (double)tree.getNumOfLeaves()},
+        });
+    }
+    report.write(outputPath);
+}
+
+double getAccuracy(Node* root, const Dataset &dataset, const vector<int> &rows) {
+    int numOfCorrect = 0;
+    for (int r : rows) numOfCorrect += (predict(root, dataset.row(r)) == dataset.labels[r]);
+    return (double)numOfCorrect / rows.size();
+}
+
+// grid over (maxDepth, minSize), simplest first; one presort serves every fold and configuration
+void runCrossValidation(size_t numOfRows, int numOfFolds) {
+    Dataset dataset = getSyntheticBlobs(numOfRows, 4, 4, 4.0);
+    vector<int> folds = getFoldAssignments(dataset.size(), numOfFolds);
+    vector<pair<int, int>> configs;
+    vector<string> configNames;
+    for (int maxDepth : {1, 2, 3, 4, 6, 8}) {
+        for (int minSize : {20, 10, 5, 1}) {
+            configs.push_back({maxDepth, minSize});
+            configNames.push_back("maxDepth=" + to_string(maxDepth) + " minSize=" + to_string(minSize));
+        }
+    }
+
+    PresortedFeatures presorted;
+    double presortSeconds = timeSeconds([&]() { presorted = presortFeatures(dataset); });
+    CrossValidationResult result = crossValidate(configs.size(), numOfFolds, [&](int fold, double *scores) {
+        vector<int> trainRows = getFoldRows(folds, fold, false);
+        vector<int> testRows = getFoldRows(folds, fold, true);
+        parallelFor(0, configs.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t c=begin; c<end; c++) {
+                Node* root = buildTree(dataset, trainRows, configs[c].first, configs[c].second, &presorted);
+                scores[c] = getAccuracy(root, dataset, testRows);
+                deleteTree(root);
+            }
+        });
+    });
+    printCrossValidation(result, configNames);
+    cout << "presort: " << presortSeconds << " s, total search time: " << presortSeconds + result.seconds << " s" << endl;
+}
+
+// test-then-train over a stream of examples, against a batch tree on a prefix
+void runOnline(size_t numOfRows) {
+    const size_t numOfTestRows = 20000;
+    Dataset blobs = getSyntheticBlobs(numOfRows + numOfTestRows, 4, 4, 4.0);
+    HoeffdingTree tree(blobs.numOfFeatures());
+    size_t reportEvery = max<size_t>(1, numOfRows / 10);
+    size_t numOfCorrect = 0;
+    double seconds = timeSeconds([&]() {
+        for (size_t r=0; r<numOfRows; r++) {
+            numOfCorrect += (predict(tree.getRoot(), blobs.row(r)) == blobs.labels[r]);
+            tree.learn(blobs.row(r), blobs.labels[r]);
+            if ((r + 1) % reportEvery == 0) {
+                cout << "samples: " << r + 1 << ", leaves: " << tree.getNumOfLeaves()
+                    << ", prequential accuracy: " << (double)numOfCorrect / reportEvery << endl;
+                numOfCorrect = 0;
+            }
+        }
+    });
+    cout << numOfRows / seconds << " samples/s" << endl;
+
+    vector<int> testRows(numOfTestRows);
+    for (size_t i=0; i<numOfTestRows; i++) testRows[i] = numOfRows + i;
+    vector<int> trainRows(min(numOfRows, MAX_BENCH_TRAIN_ROWS));
+    for (size_t i=0; i<trainRows.size(); i++) trainRows[i] = i;
+    Node* batchRoot = buildTree(blobs, trainRows, 5, 10);
+    cout << "held-out accuracy: hoeffding " << getAccuracy(tree.getRoot(), blobs, testRows)
+        << ", batch CART on " << trainRows.size() << " rows " << getAccuracy(batchRoot, blobs, testRows) << endl;
+    deleteTree(batchRoot);
+}
+
+// preorder, so the root is node 0
+int flattenTree(Node* node, vector<TreeModelNode> &nodes) {
+    if (node == nullptr) return -1;
+    int idx = nodes.size();
+    nodes.push_back({node->featureIdx, -1, -1, node->featureValue, node->label});
+    if (node->label != -1) return idx;
+    int left = flattenTree(node->left, nodes);
+    int right = flattenTree(node->right, nodes);
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    return idx;
+}
+
+TreeModel toTreeModel(Node* root, size_t numOfFeatures) {
+    vector<TreeModelNode> nodes;
+    flattenTree(root, nodes);
+    return TreeModel(nodes, numOfFeatures);
+}
+
+// presorted CART on synthetic blobs, written for the inference server
+void saveModel(string path, size_t numOfRows, int maxDepth) {
+    Dataset blobs = getSyntheticBlobs(numOfRows, 8, 4, 4.0);
+    PresortedFeatures presorted = presortFeatures(blobs);
+    Node* root = buildTree(blobs, maxDepth, 10, &presorted);
+    vector<int> rows(blobs.size());
+    for (size_t r=0; r<rows.size(); r++) rows[r] = r;
+    toTreeModel(root, blobs.numOfFeatures()).save(path);
+    cout << "saved " << path << ", train accuracy " << getAccuracy(root, blobs, rows) << endl;
+    deleteTree(root);
+}
+
+/**
+ * trains on a zero-copy prefix of a columnar file (the split search scans one
+ * feature at a time, which is a sequential read of a mapped column) and
+ * tests on the remaining rows
+ */
+void runColumnar(string path, int maxDepth) {
+    if (path.empty()) {
+        path = "blobs.mlcf";
+        writeColumnar(path, getSyntheticBlobs(20000, 4, 4, 4.0));
+    }
+    ColumnarFile file(path);
+    size_t numOfTrainRows = min(file.getNumOfRows() / 2, MAX_BENCH_TRAIN_ROWS);
+    Dataset trainSet = file.getDataset(0, numOfTrainRows);
+    Dataset testSet = file.getDataset(numOfTrainRows, file.getNumOfRows());
+    Node* root = buildTree(trainSet, maxDepth, 10);
+
+    int numOfCorrect = 0;
+    vector<double> row(testSet.numOfFeatures());
+    for (size_t r=0; r<testSet.size(); r++) {
+        for (size_t f=0; f<row.size(); f++) row[f] = testSet.features(r, f);
+        if (predict(root, row.data()) == testSet.labels[r]) numOfCorrect++;
+    }
+    cout << path << ": trained on " << numOfTrainRows << " rows, accuracy on "
+        << testSet.size() << " rows = " << (double)numOfCorrect / testSet.size() << endl;
+}
+
+/**
+ * usage: ./main                           (toy dataset)
+ *        ./main cv [rows] [folds]         (maxDepth / minSize grid search on synthetic blobs)
+ *        ./main online [rows]             (Hoeffding tree over a stream of synthetic blobs)
+ *        ./main columnar [path] [depth]   (columnar file from CsvToColumnar, synthetic blobs without a path)
+ *        ./main save [model.mlmd] [rows] [depth]  (CART on synthetic blobs, writes the model)
+ *        ./main suite [rows] [out.json]   (synthetic blobs benchmark)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "cv") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 5000;
+        int numOfFolds = (argc > 3) ? stoi(argv[3]) : 5;
+        runCrossValidation(numOfRows, numOfFolds);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "online") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 200000;
+        runOnline(numOfRows);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "save") {
+        string path = (argc > 2) ? argv[2] : "tree.mlmd";
+        size_t numOfRows = (argc > 3) ? stoul(argv[3]) : 20000;
+        int maxDepth = (argc > 4) ? stoi(argv[4]) : 8;
+        saveModel(path, numOfRows, maxDepth);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "columnar") {
+        string path = (argc > 2) ? argv[2] : "";
+        int maxDepth = (argc > 3) ? stoi(argv[3]) : 5;
+        runColumnar(path, maxDepth);
+        return 0;
+    }
     
-    vector<vector<double>> dataset = {
+    Dataset dataset = Dataset::fromRows({
         {2.771244718,1.784783929,0},
         {1.728571309,1.169761413,0},
         {3.678319846,2.81281357,0},
@@ -240,14 +842,14 @@ int main() {
         {7.444542326,0.476683375,1},
         {10.12493903,3.234550982,1},
         {6.642287351,3.319983761,1}
-    };
+    });
     
     Node* root = buildTree(dataset, 1, 1);
     
     printTree(root, 0);
     
-    for (auto data : dataset) {
-        double pred = predict(root, data);
-        cout << "pred: " << pred << ", gt: " << data[data.size()-1] << endl;
+    for (int i=0; i<dataset.size(); i++) {
+        double pred = predict(root, dataset.row(i));
+        cout << "pred: " << pred << ", gt: " << dataset.labels[i] << endl;
     }
 }
\ No newline at end of file
@@ -9,116 +9,312 @@ Simple linear regression algorithm:
 Note: 
 sum(y_i - y_mean) = sum(y_i) - sum(y_mean) = 0
 sum((x_i - x_mean) * (y_i * y_mean)) = sum(x_i * (y_i * y_mean))
+
+One-pass sufficient statistics:
+SufficientStats keeps count, means, M2 of x and y and the co-moment in a
+single pass (Welford). Two accumulators merge exactly (Chan et al.), so chunks
+can be processed by parallel threads or streamed from disk and combined.
 */
 
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#include "../common/matrix.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
 
 using namespace std;
 
-double getMean(vector<double> values) {
+double getMean(const double *values, size_t n) {
     double sum = 0;
-    for (auto value : values) {
-        sum += value;
+    for (size_t i=0; i<n; i++) {
+        sum += values[i];
     }
-    return sum / values.size();
+    return sum / n;
 }
 
-double getVariance(vector<double> values) {
-    double mean = getMean(values);
+double getVariance(const double *values, size_t n) {
+    double mean = getMean(values, n);
     double variance = 0;
-    for (auto value : values) {
-        variance += pow(value - mean, 2);
+    for (size_t i=0; i<n; i++) {
+        variance += pow(values[i] - mean, 2);
     }
     return variance;
 }
 
-double getCovariance(vector<double> valuesA, vector<double> valuesB) {
-    double meanA = getMean(valuesA);
-    double meanB = getMean(valuesB);
+double getCovariance(const double *valuesA, const double *valuesB, size_t n) {
+    double meanA = getMean(valuesA, n);
+    double meanB = getMean(valuesB, n);
     double covariance = 0;
-    for (int i=0; i<valuesA.size(); i++) {
+    for (size_t i=0; i<n; i++) {
         covariance += (valuesA[i] - meanA) * (valuesB[i] - meanB);
     }
     return covariance;
 }
 
-vector<double> getCoefficients(const vector<vector<double>> &dataset) {
-    // get xs and ys
-    vector<double> xs;
-    vector<double> ys;
-    for (auto pair : dataset) {
-        xs.push_back(pair[0]);
-        ys.push_back(pair[1]);
-    }
+// dataset is column-major, so the single feature column is contiguous
+vector<double> getCoefficients(const Dataset &dataset) {
+    const double *xs = dataset.features.col(0);
+    const double *ys = dataset.labels.data();
+    size_t n = dataset.size();
     
     // calculate coefficients
-    double b1 = getCovariance(xs, ys) / getVariance(xs);
-    double b0 = getMean(ys) - b1 * getMean(xs);
+    double b1 = getCovariance(xs, ys, n) / getVariance(xs, n);
+    double b0 = getMean(ys, n) - b1 * getMean(xs, n);
     
     return {b0, b1};
 }
 
-vector<double> myGetCoefficients(const vector<vector<double>> &dataset) {
-    // get xs and ys
-    vector<double> xs;
-    vector<double> ys;
-    for (auto pair : dataset) {
-        xs.push_back(pair[0]);
-        ys.push_back(pair[1]);
-    }
+vector<double> myGetCoefficients(const Dataset &dataset) {
+    const double *xs = dataset.features.col(0);
+    const double *ys = dataset.labels.data();
+    size_t n = dataset.size();
+    double meanX = getMean(xs, n);
+    double meanY = getMean(ys, n);
     
     // calculate coefficients
     double numeratro = 0;
-    for (int i=0; i<dataset.size(); i++) {
-        numeratro += dataset[i][0] * (ys[i] - getMean(ys));
+    for (size_t i=0; i<n; i++) {
+        numeratro += xs[i] * (ys[i] - meanY);
     }
     double denuminator = 0;
-    for (int i=0; i<dataset.size(); i++) {
-        denuminator += dataset[i][0] * (xs[i] - getMean(xs));
+    for (size_t i=0; i<n; i++) {
+        denuminator += xs[i] * (xs[i] - meanX);
     }
     
     double b1 = numeratro / denuminator;
-    double b0 = getMean(ys) - b1 * getMean(xs);
+    double b0 = meanY - b1 * meanX;
     
     return {b0, b1};
 }
 
-double predict(double x, vector<double> coefficents) {
+struct SufficientStats {
+    uint64_t count = 0;
+    double meanX = 0, meanY = 0;
+    double m2X = 0, m2Y = 0; // sum((x - meanX)^2), sum((y - meanY)^2)
+    double coMoment = 0;     // sum((x - meanX) * (y - meanY))
+
+    void push(double x, double y) {
+        count++;
+        double dx = x - meanX;
+        double dy = y - meanY;
+        meanX += dx / count;
+        meanY += dy / count;
+        // (old delta) * (new delta) keeps the sums exact
+        m2X += dx * (x - meanX);
+        m2Y += dy * (y - meanY);
+        coMoment += dx * (y - meanY);
+    }
+
+    void merge(const SufficientStats &other) {
+        if (other.count == 0) return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        double n = count + other.count;
+        double dx = other.meanX - meanX;
+        double dy = other.meanY - meanY;
+        double weight = (double)count * other.count / n;
+        m2X += other.m2X + dx * dx * weight;
+        m2Y += other.m2Y + dy * dy * weight;
+        coMoment += other.coMoment + dx * dy * weight;
+        meanX += dx * other.count / n;
+        meanY += dy * other.count / n;
+        count += other.count;
+    }
+
+    // same un-normalized variance / covariance as getVariance / getCovariance
+    double getVarianceX() const { return m2X; }
+    double getVarianceY() const { return m2Y; }
+    double getCovariance() const { return coMoment; }
+
+    vector<double> getCoefficients() const {
+        if (count < 2) throw runtime_error("cannot fit a line to " + to_string(count) + " rows");
+        if (m2X == 0) throw runtime_error("cannot fit a line, all x are equal");
+        double b1 = coMoment / m2X;
+        double b0 = meanY - b1 * meanX;
+        return {b0, b1};
+    }
+};
+
+SufficientStats getSufficientStats(const double *xs, const double *ys, size_t n) {
+    SufficientStats stats;
+    for (size_t i=0; i<n; i++) stats.push(xs[i], ys[i]);
+    return stats;
+}
+
+// one pass over n (x, y) pairs, split into one chunk per thread and merged in order
+SufficientStats getSufficientStatsParallel(
+    const double *xs, const double *ys, size_t n,
+    int numOfThreads = thread::hardware_concurrency()) {
+
+    numOfThreads = max(1, min<int>(numOfThreads, n));
+    vector<SufficientStats> partials(numOfThreads);
+    size_t chunkSize = (n + numOfThreads - 1) / numOfThreads;
+    vector<thread> workers;
+    for (int t=0; t<numOfThreads; t++) {
+        size_t begin = min(n, t * chunkSize), end = min(n, begin + chunkSize);
+        workers.emplace_back([&, t, begin, end]() {
+            partials[t] = getSufficientStats(xs + begin, ys + begin, end - begin);
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    SufficientStats stats;
+    for (auto &partial : partials) stats.merge(partial);
+    return stats;
+}
+
+/**
+ * streams (x, y) pairs of doubles from a raw binary file in fixed-size chunks,
+ * every chunk is reduced in parallel and merged into the running stats
+ */
+SufficientStats getSufficientStatsFromFile(const string &path, size_t chunkPairs = 1 << 20) {
+    SufficientStats stats;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) throw runtime_error("cannot open " + path);
+
+    vector<double> buffer(2 * chunkPairs), xs(chunkPairs), ys(chunkPairs);
+    size_t numOfValues;
+    while ((numOfValues = fread(buffer.data(), sizeof(double), buffer.size(), file)) >= 2) {
+        size_t n = numOfValues / 2;
+        for (size_t i=0; i<n; i++) {
+            xs[i] = buffer[2 * i];
+            ys[i] = buffer[2 * i + 1];
+        }
+        stats.merge(getSufficientStatsParallel(xs.data(), ys.data(), n));
+    }
+    bool failed = ferror(file);
+    fclose(file);
+    if (failed) throw runtime_error("cannot read " + path);
+    return stats;
+}
+
+// one-pass fit on n generated rows of y = 2 + 3x + noise
+void benchmarkSufficientStats(size_t n) {
+    vector<double> xs(n), ys(n);
+    mt19937_64 rng(1);
+    normal_distribution<double> noise(0, 1);
+    for (size_t i=0; i<n; i++) {
+        xs[i] = 1e4 + 100.0 * i / n; // large offset relative to the spread, naive sums lose digits here
+        ys[i] = 2 + 3 * xs[i] + noise(rng);
+    }
+
+    for (int numOfThreads : {1, (int)thread::hardware_concurrency()}) {
+        auto start = chrono::steady_clock::now();
+        SufficientStats stats = getSufficientStatsParallel(xs.data(), ys.data(), n, numOfThreads);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        vector<double> coefficents = stats.getCoefficients();
+        cout << "threads: " << numOfThreads
+            << ", rows/sec: " << n / seconds
+            << ", GB/s: " << 2 * n * sizeof(double) / seconds * 1e-9
+            << ", coefficents = {" << coefficents[0] << ", " << coefficents[1] << "}" << endl;
+    }
+}
+
+double predict(double x, const vector<double> &coefficents) {
     return x * coefficents[1] + coefficents[0];
 }
 
 double evaluation(
-    const vector<vector<double>> &dataset, 
+    const Dataset &dataset, 
     const vector<double> &predictions) {
     
     // rmse
     double sum = 0;
-    for (int i=0; i<dataset.size(); i++) {
-        sum += pow(dataset[i][1] - predictions[i], 2);
+    for (size_t i=0; i<dataset.size(); i++) {
+        sum += pow(dataset.labels[i] - predictions[i], 2);
     }
     return sqrt(sum / dataset.size());
 }
 
-int main() {
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("SimpleLinearReg");
+    vector<double> trueCoefficents;
+    Dataset trainSet = getSyntheticLinear(numOfRows, 1, 0.1, 42, &trueCoefficents);
+    trainSet.features = trainSet.features.toLayout(Layout::COL_MAJOR);
+
+    auto getMetrics = [&](const vector<double> &coefficents) -> vector<pair<string, double>> {
+        vector<double> predictions(trainSet.size());
+        for (size_t i=0; i<trainSet.size(); i++) predictions[i] = predict(trainSet.features(i, 0), coefficents);
+        return {
+            {"rmse", evaluation(trainSet, predictions)},
+            {"slopeError", fabs(coefficents[1] - trueCoefficents[1])},
+        };
+    };
+
+    vector<double> coefficents;
+    double seconds = timeSeconds([&]() { coefficents = getCoefficients(trainSet); });
+    report.add("closed_form", numOfRows, 1, seconds, getMetrics(coefficents));
+
+    int numOfThreads = thread::hardware_concurrency();
+    seconds = timeSeconds([&]() {
+        SufficientStats stats = getSufficientStatsParallel(
+            trainSet.features.col(0), trainSet.labels.data(), trainSet.size(), numOfThreads);
+        coefficents = stats.getCoefficients();
+    });
+    report.add("one_pass_parallel", numOfRows, 1, seconds, getMetrics(coefficents));
+    report.write(outputPath);
+}
+
+/**
+ * usage: ./main                  (toy dataset)
+ *        ./main bench [rows]     (one-pass parallel fit on generated rows)
+ *        ./main file <path>      (one-pass fit over raw binary (x, y) double pairs)
+ *        ./main suite [rows] [out.json]  (synthetic benchmark, JSON results)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "bench") {
+        size_t n = (argc > 2) ? stoul(argv[2]) : 20000000;
+        benchmarkSufficientStats(n);
+        return 0;
+    }
+    if (argc > 2 && string(argv[1]) == "file") {
+        SufficientStats stats = getSufficientStatsFromFile(argv[2]);
+        vector<double> coefficents = stats.getCoefficients();
+        cout << "rows: " << stats.count << ", coefficents = {"
+            << coefficents[0] << ", " << coefficents[1] << "}" << endl;
+        return 0;
+    }
     
-    vector<vector<double>> trainSet = {
+    Dataset trainSet = Dataset::fromRows({
         {1, 1},
         {2, 3},
         {4, 3},
         {3, 2},
         {5, 5}
-    };
+    }, Layout::COL_MAJOR);
     
-    auto coefficents = getCoefficients(trainSet);    
+    auto coefficents = getCoefficients(trainSet);
     cout << "coefficents = {" 
         << coefficents[0] << ", "
         << coefficents[1] << "}"<< endl;
     vector<double> predictions;
-    for (auto pair : trainSet) {
-        predictions.push_back(predict(pair[0], coefficents));
+    for (size_t i=0; i<trainSet.size(); i++) {
+        predictions.push_back(predict(trainSet.features(i, 0), coefficents));
     }
     double rms = evaluation(trainSet, predictions);
     cout << rms << endl;
+
+    SufficientStats stats;
+    for (size_t i=0; i<trainSet.size(); i++) stats.push(trainSet.features(i, 0), trainSet.labels[i]);
+    auto onePassCoefficents = stats.getCoefficients();
+    cout << "one-pass coefficents = {"
+        << onePassCoefficents[0] << ", "
+        << onePassCoefficents[1] << "}"<< endl;
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+/*
+Benchmark results as JSON, one file per program
+
+BenchReport report("k-means");
+report.add("lloyd", numOfRows, numOfDims, seconds, {{"inertia", inertia}});
+report.write("bench_results/k-means.json");
+
+every entry records the wall time and rows/sec next to a quality metric,
+so a faster version that silently got worse shows up in the same diff.
+keys are written in a fixed order and numbers with fixed precision to keep
+diffs between versions small.
+*/
+
+#ifndef ML_COMMON_BENCH_H
+#define ML_COMMON_BENCH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+struct BenchEntry {
+    std::string name;
+    size_t numOfRows;
+    size_t numOfDims;
+    double seconds;
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+class BenchReport {
+public:
+    BenchReport(std::string program) { mProgram = program; }
+
+    // rowsPerSec is numOfRows * numOfPasses / seconds
+    void add(std::string name, size_t numOfRows, size_t numOfDims, double seconds,
+        std::vector<std::pair<std::string, double>> metrics = {}, int numOfPasses = 1) {
+
+        metrics.insert(metrics.begin(), {"rowsPerSec", (seconds > 0) ? numOfRows * numOfPasses / seconds : 0});
+        mEntries.push_back({name, numOfRows, numOfDims, seconds, metrics});
+
+        std::cout << mProgram << " / " << name << ": rows=" << numOfRows
+            << ", dims=" << numOfDims << ", seconds=" << seconds;
+        for (auto &metric : metrics) std::cout << ", " << metric.first << "=" << metric.second;
+        std::cout << std::endl;
+    }
+
+    // throws if the file cannot be created or written
+    void write(std::string path) const {
+        std::ofstream file(path);
+        if (!file) throw std::runtime_error("cannot open " + path);
+        file << "{\n  \"program\": \"" << mProgram << "\",\n"
+            << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+            << "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n"
+            << "  \"results\": [";
+        for (size_t e=0; e<mEntries.size(); e++) {
+            const BenchEntry &entry = mEntries[e];
+            file << (e > 0 ? "," : "") << "\n    {\"name\": \"" << entry.name << "\""
+                << ", \"rows\": " << entry.numOfRows
+                << ", \"dims\": " << entry.numOfDims
+                << ", \"seconds\": " << formatNumber(entry.seconds);
+            for (auto &metric : entry.metrics) {
+                file << ", \"" << metric.first << "\": " << formatNumber(metric.second);
+            }
+            file << "}";
+        }
+        file << "\n  ]\n}\n";
+        file.close();
+        if (!file) throw std::runtime_error("cannot write " + path);
+        std::cout << "results written to " << path << std::endl;
+    }
+
+private:
+    std::string mProgram;
+    std::vector<BenchEntry> mEntries;
+
+    static std::string formatNumber(double value) {
+        if (value != value || value - value != 0) return "null"; // nan / inf are not valid JSON
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.6g", value);
+        return buffer;
+    }
+};
+
+template <typename Func>
+double timeSeconds(Func func) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
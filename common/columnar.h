@@ -0,0 +1,379 @@
+/*
+Memory-mapped columnar dataset files
+
+written once (e.g. from CSV by CsvToColumnar), then opened with mmap: opening
+costs one page fault per touched page instead of a parse, and several
+processes reading the same file share it through the page cache. Float64
+columns come back as borrowed Matrix / Array views into the mapping, so the
+algorithms read the file without copying it.
+
+file layout (little endian, every section 64-byte aligned):
+    header, 64 bytes
+        char[4]  magic "MLCF"
+        uint32   version (1)
+        uint64   numOfRows
+        uint32   numOfCols
+        uint32   blockRows       rows per statistics block, 0 = no statistics
+        uint64   statsOffset     0 = no statistics
+        uint8    reserved[32]
+    column descriptors, 64 bytes each
+        char[48] name            NUL padded
+        uint32   type            ColumnType
+        uint32   reserved
+        uint64   offset          first value of the column
+    column data
+        numOfRows values per column, padded to a multiple of 64 bytes, so
+        consecutive float64 columns form a column-major matrix with leading
+        dimension getPaddedRows()
+    statistics
+        double min, max of block b of column c at
+        statsOffset + (c * numOfBlocks + b) * 16
+*/
+
+#ifndef ML_COMMON_COLUMNAR_H
+#define ML_COMMON_COLUMNAR_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix.h"
+
+enum class ColumnType : uint32_t { FLOAT64 = 1 };
+
+const size_t COLUMNAR_ALIGNMENT = 64;
+const size_t COLUMNAR_HEADER_BYTES = 64;
+const size_t COLUMNAR_DESCRIPTOR_BYTES = 64;
+const size_t COLUMNAR_MAX_NAME_LENGTH = 47;
+
+struct ColumnarHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t numOfRows;
+    uint32_t numOfCols;
+    uint32_t blockRows;
+    uint64_t statsOffset;
+    uint8_t reserved[32];
+};
+
+struct ColumnDescriptor {
+    char name[48];
+    ColumnType type;
+    uint32_t reserved;
+    uint64_t offset;
+};
+
+static_assert(sizeof(ColumnarHeader) == COLUMNAR_HEADER_BYTES, "header must be 64 bytes");
+static_assert(sizeof(ColumnDescriptor) == COLUMNAR_DESCRIPTOR_BYTES, "column descriptor must be 64 bytes");
+
+inline size_t alignColumnar(size_t bytes) {
+    return (bytes + COLUMNAR_ALIGNMENT - 1) / COLUMNAR_ALIGNMENT * COLUMNAR_ALIGNMENT;
+}
+
+/**
+ * streams rows in (row-major, one double per column) and scatters them into
+ * the columns with pwrite, so memory use does not grow with the file
+ */
+class ColumnarWriter {
+public:
+    ColumnarWriter(const std::string &path, const std::vector<std::string> &names,
+        uint64_t numOfRows, uint32_t blockRows = 1 << 16) {
+
+        mPath = path;
+        mNumOfRows = numOfRows;
+        mNumOfCols = names.size();
+        mBlockRows = blockRows;
+        mFd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (mFd < 0) throw std::runtime_error("cannot open " + path);
+
+        size_t columnBytes = alignColumnar(numOfRows * sizeof(double));
+        uint64_t offset = alignColumnar(COLUMNAR_HEADER_BYTES + mNumOfCols * COLUMNAR_DESCRIPTOR_BYTES);
+        mDescriptors.resize(mNumOfCols);
+        for (size_t c=0; c<mNumOfCols; c++) {
+            ColumnDescriptor &descriptor = mDescriptors[c];
+            memset(&descriptor, 0, sizeof(descriptor));
+            strncpy(descriptor.name, names[c].c_str(), COLUMNAR_MAX_NAME_LENGTH);
+            descriptor.type = ColumnType::FLOAT64;
+            descriptor.offset = offset;
+            offset += columnBytes;
+        }
+        mStatsOffset = (blockRows > 0) ? offset : 0;
+        mNumOfBlocks = (blockRows > 0) ? (numOfRows + blockRows - 1) / blockRows : 0;
+        mStats.resize(mNumOfCols * mNumOfBlocks * 2);
+        for (size_t i=0; i<mStats.size(); i+=2) {
+            mStats[i] = DBL_MAX;
+            mStats[i+1] = -DBL_MAX;
+        }
+        mFileBytes = offset + mStats.size() * sizeof(double);
+    }
+
+    // an unfinished file keeps its zeroed header and is rejected by ColumnarFile
+    ~ColumnarWriter() {
+        if (mFd >= 0) ::close(mFd);
+    }
+
+    // rows[r * numOfCols + c], appended after the rows written so far
+    void writeRows(const double *rows, size_t numOfRows) {
+        if (mNumOfWritten + numOfRows > mNumOfRows) throw std::runtime_error("too many rows for " + mPath);
+        mColumnBuffer.resize(numOfRows);
+        for (size_t c=0; c<mNumOfCols; c++) {
+            for (size_t r=0; r<numOfRows; r++) {
+                double value = rows[r * mNumOfCols + c];
+                mColumnBuffer[r] = value;
+                if (mNumOfBlocks > 0) {
+                    double *stats = &mStats[(c * mNumOfBlocks + (mNumOfWritten + r) / mBlockRows) * 2];
+                    stats[0] = std::min(stats[0], value);
+                    stats[1] = std::max(stats[1], value);
+                }
+            }
+            writeAt(mColumnBuffer.data(), numOfRows * sizeof(double),
+                mDescriptors[c].offset + mNumOfWritten * sizeof(double));
+        }
+        mNumOfWritten += numOfRows;
+    }
+
+    // header and statistics are written last, so a crashed conversion never looks valid
+    void close() {
+        if (mFd < 0) return;
+        if (mNumOfWritten != mNumOfRows) {
+            ::close(mFd);
+            mFd = -1;
+            throw std::runtime_error("expected " + std::to_string(mNumOfRows) + " rows in " + mPath);
+        }
+        if (!mStats.empty()) writeAt(mStats.data(), mStats.size() * sizeof(double), mStatsOffset);
+        if (ftruncate(mFd, mFileBytes) != 0) throw std::runtime_error("cannot resize " + mPath);
+
+        ColumnarHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "MLCF", 4);
+        header.version = 1;
+        header.numOfRows = mNumOfRows;
+        header.numOfCols = mNumOfCols;
+        header.blockRows = mBlockRows;
+        header.statsOffset = mStatsOffset;
+        writeAt(mDescriptors.data(), mDescriptors.size() * sizeof(ColumnDescriptor), COLUMNAR_HEADER_BYTES);
+        writeAt(&header, sizeof(header), 0);
+        ::close(mFd);
+        mFd = -1;
+    }
+
+private:
+    std::string mPath;
+    int mFd = -1;
+    uint64_t mNumOfRows;
+    uint32_t mNumOfCols;
+    uint32_t mBlockRows;
+    uint64_t mNumOfBlocks;
+    uint64_t mStatsOffset;
+    uint64_t mFileBytes;
+    uint64_t mNumOfWritten = 0;
+    std::vector<ColumnDescriptor> mDescriptors;
+    std::vector<double> mStats;
+    std::vector<double> mColumnBuffer;
+
+    void writeAt(const void *data, size_t bytes, uint64_t offset) {
+        const char *p = static_cast<const char *>(data);
+        while (bytes > 0) {
+            ssize_t written = pwrite(mFd, p, bytes, offset);
+            if (written <= 0) throw std::runtime_error("cannot write " + mPath);
+            p += written;
+            bytes -= written;
+            offset += written;
+        }
+    }
+};
+
+// label is the last column, the features are named x0, x1, ...
+inline void writeColumnar(const std::string &path, const Dataset &dataset, uint32_t blockRows = 1 << 16) {
+    size_t numOfFeatures = dataset.numOfFeatures();
+    std::vector<std::string> names;
+    for (size_t c=0; c<numOfFeatures; c++) names.push_back("x" + std::to_string(c));
+    names.push_back("label");
+
+    ColumnarWriter writer(path, names, dataset.size(), blockRows);
+    const size_t chunkRows = 4096;
+    std::vector<double> rows(chunkRows * (numOfFeatures + 1));
+    for (size_t begin=0; begin<dataset.size(); begin+=chunkRows) {
+        size_t end = std::min(dataset.size(), begin + chunkRows);
+        for (size_t r=begin; r<end; r++) {
+            double *row = &rows[(r - begin) * (numOfFeatures + 1)];
+            for (size_t c=0; c<numOfFeatures; c++) row[c] = dataset.features(r, c);
+            row[numOfFeatures] = dataset.labels[r];
+        }
+        writer.writeRows(rows.data(), end - begin);
+    }
+    writer.close();
+}
+
+// one read-only, private mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        mSize = info.st_size;
+        // private + writable: pages stay shared with the page cache until
+        // someone writes to them (copy-on-write), the file never changes
+        mData = (mSize > 0) ? mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : nullptr;
+        ::close(fd);
+        if (mData == MAP_FAILED) throw std::runtime_error("cannot mmap " + path);
+    }
+
+    ~MappedFile() {
+        if (mData != nullptr) munmap(mData, mSize);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    char *data() const { return static_cast<char *>(mData); }
+    size_t size() const { return mSize; }
+
+private:
+    void *mData = nullptr;
+    size_t mSize = 0;
+};
+
+class ColumnarFile {
+public:
+    ColumnarFile(const std::string &path) {
+        mPath = path;
+        mFile = std::make_shared<MappedFile>(path);
+        if (mFile->size() < COLUMNAR_HEADER_BYTES) throw std::runtime_error("truncated header in " + path);
+
+        memcpy(&mHeader, mFile->data(), sizeof(mHeader));
+        if (memcmp(mHeader.magic, "MLCF", 4) != 0) throw std::runtime_error(path + " is not a columnar file");
+        if (mHeader.version != 1) throw std::runtime_error("unsupported version in " + path);
+
+        size_t descriptorsEnd = COLUMNAR_HEADER_BYTES + (size_t)mHeader.numOfCols * COLUMNAR_DESCRIPTOR_BYTES;
+        if (mFile->size() < descriptorsEnd) throw std::runtime_error("truncated header in " + path);
+        mDescriptors.resize(mHeader.numOfCols);
+        memcpy(mDescriptors.data(), mFile->data() + COLUMNAR_HEADER_BYTES, mDescriptors.size() * sizeof(ColumnDescriptor));
+        for (auto &descriptor : mDescriptors) {
+            descriptor.name[sizeof(descriptor.name) - 1] = '\0';
+            if (descriptor.type != ColumnType::FLOAT64) throw std::runtime_error("unknown column type in " + path);
+            if (descriptor.offset % COLUMNAR_ALIGNMENT != 0 ||
+                descriptor.offset + mHeader.numOfRows * sizeof(double) > mFile->size()) {
+                throw std::runtime_error("column out of bounds in " + path);
+            }
+        }
+        if (mHeader.statsOffset != 0 &&
+            mHeader.statsOffset + mHeader.numOfCols * getNumOfBlocks() * 2 * sizeof(double) > mFile->size()) {
+            throw std::runtime_error("statistics out of bounds in " + path);
+        }
+    }
+
+    // only checks the magic, for format detection
+    static bool isColumnarFile(const std::string &path) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr) return false;
+        char magic[4] = {0};
+        bool isColumnar = fread(magic, 1, 4, file) == 4 && memcmp(magic, "MLCF", 4) == 0;
+        fclose(file);
+        return isColumnar;
+    }
+
+    size_t getNumOfRows() const { return mHeader.numOfRows; }
+    size_t getNumOfCols() const { return mHeader.numOfCols; }
+    size_t getPaddedRows() const { return alignColumnar(mHeader.numOfRows * sizeof(double)) / sizeof(double); }
+    std::string getColumnName(size_t c) const { return mDescriptors[c].name; }
+
+    int getColumnIdx(const std::string &name) const {
+        for (size_t c=0; c<mDescriptors.size(); c++) {
+            if (name == mDescriptors[c].name) return c;
+        }
+        return -1;
+    }
+
+    const double *getColumn(size_t c) const {
+        return reinterpret_cast<const double *>(mFile->data() + mDescriptors[c].offset);
+    }
+
+    size_t getBlockRows() const { return mHeader.blockRows; }
+    size_t getNumOfBlocks() const {
+        return (mHeader.blockRows == 0) ? 0 : (mHeader.numOfRows + mHeader.blockRows - 1) / mHeader.blockRows;
+    }
+
+    // min / max of rows [b * blockRows, (b+1) * blockRows) of column c, false without statistics
+    bool getBlockStats(size_t c, size_t b, double &min, double &max) const {
+        if (mHeader.statsOffset == 0) return false;
+        const double *stats = reinterpret_cast<const double *>(mFile->data() + mHeader.statsOffset);
+        min = stats[(c * getNumOfBlocks() + b) * 2];
+        max = stats[(c * getNumOfBlocks() + b) * 2 + 1];
+        return true;
+    }
+
+    // zero-copy column-major view of rows [firstRow, endRow) of columns [firstCol, endCol)
+    Matrix<double> getMatrix(size_t firstCol, size_t endCol, size_t firstRow = 0, size_t endRow = SIZE_MAX) const {
+        checkConsecutive(firstCol, endCol);
+        endRow = checkRows(firstRow, endRow);
+        return Matrix<double>::borrow(getMutableColumn(firstCol) + firstRow, endRow - firstRow, endCol - firstCol,
+            Layout::COL_MAJOR, getPaddedRows(), mFile);
+    }
+
+    Array<double> getArray(size_t c, size_t firstRow = 0, size_t endRow = SIZE_MAX) const {
+        endRow = checkRows(firstRow, endRow);
+        return Array<double>::borrow(getMutableColumn(c) + firstRow, endRow - firstRow, mFile);
+    }
+
+    // features [firstCol, endCol) and labelCol, all borrowed from the mapping
+    Dataset getDataset(size_t firstCol, size_t endCol, size_t labelCol,
+        size_t firstRow = 0, size_t endRow = SIZE_MAX) const {
+
+        Dataset dataset;
+        dataset.features = getMatrix(firstCol, endCol, firstRow, endRow);
+        dataset.labels = getArray(labelCol, firstRow, endRow);
+        return dataset;
+    }
+
+    // features are every column but the last, the label is the last one
+    Dataset getDataset(size_t firstRow = 0, size_t endRow = SIZE_MAX) const {
+        if (getNumOfCols() < 2) throw std::runtime_error(mPath + " needs at least two columns");
+        return getDataset(0, getNumOfCols() - 1, getNumOfCols() - 1, firstRow, endRow);
+    }
+
+private:
+    std::string mPath;
+    std::shared_ptr<MappedFile> mFile;
+    ColumnarHeader mHeader;
+    std::vector<ColumnDescriptor> mDescriptors;
+
+    // the mapping is private, writes through this pointer never reach the file
+    double *getMutableColumn(size_t c) const {
+        return reinterpret_cast<double *>(mFile->data() + mDescriptors[c].offset);
+    }
+
+    size_t checkRows(size_t firstRow, size_t endRow) const {
+        endRow = std::min(endRow, getNumOfRows());
+        if (firstRow > endRow) throw std::runtime_error("bad row range for " + mPath);
+        return endRow;
+    }
+
+    void checkConsecutive(size_t firstCol, size_t endCol) const {
+        if (firstCol >= endCol || endCol > getNumOfCols()) throw std::runtime_error("bad column range for " + mPath);
+        size_t columnBytes = getPaddedRows() * sizeof(double);
+        for (size_t c=firstCol+1; c<endCol; c++) {
+            if (mDescriptors[c].offset != mDescriptors[c-1].offset + columnBytes) {
+                throw std::runtime_error("columns are not consecutive in " + mPath);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*
+K-fold cross-validation and grid search
+
+the caller evaluates every configuration on one fold at a time, so work that
+only depends on the fold (neighbor lists, a fitted prefix, ...) is done once
+and shared by all configurations; the folds run in parallel on the shared
+pool and may run their own parallel loops.
+
+std::vector<int> folds = getFoldAssignments(dataset.size(), 5);
+CrossValidationResult result = crossValidate(configs.size(), 5,
+    [&](int fold, double *scores) {
+        ... train on rows with folds[r] != fold, test on folds[r] == fold
+        for (size_t c=0; c<configs.size(); c++) scores[c] = accuracy of configs[c];
+    });
+
+scores are "higher is better", ties go to the earlier configuration, so
+configurations should be listed from the simplest to the most complex.
+*/
+
+#ifndef ML_COMMON_CV_H
+#define ML_COMMON_CV_H
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <iostream>
+
+#include "matrix.h"
+#include "random.h"
+#include "thread_pool.h"
+#include "bench.h"
+
+// fold of every row: a seeded shuffle dealt round-robin, so fold sizes differ by at most one
+inline std::vector<int> getFoldAssignments(size_t numOfRows, int numOfFolds, uint64_t seed = 0) {
+    std::vector<size_t> order(numOfRows);
+    std::iota(order.begin(), order.end(), 0);
+    CounterRng rng(seed);
+    for (size_t i=numOfRows; i>1; i--) std::swap(order[i-1], order[rng.below(i)]);
+
+    std::vector<int> folds(numOfRows);
+    for (size_t i=0; i<numOfRows; i++) folds[order[i]] = i % numOfFolds;
+    return folds;
+}
+
+// rows of fold (isInFold) or of every other fold, in increasing order
+inline std::vector<int> getFoldRows(const std::vector<int> &folds, int fold, bool isInFold) {
+    std::vector<int> rows;
+    for (size_t r=0; r<folds.size(); r++) {
+        if ((folds[r] == fold) == isInFold) rows.push_back(r);
+    }
+    return rows;
+}
+
+struct CrossValidationResult {
+    Matrix<double> scores; // numOfConfigs x numOfFolds
+    std::vector<double> meanScores;
+    std::vector<double> stdScores;
+    size_t bestConfig = 0;
+    double seconds = 0;
+};
+
+// evaluateFold(fold, scores) fills scores[0, numOfConfigs) for one fold
+template <typename Func>
+CrossValidationResult crossValidate(size_t numOfConfigs, int numOfFolds, Func evaluateFold) {
+    CrossValidationResult result;
+    result.scores = Matrix<double>(numOfConfigs, numOfFolds, Layout::COL_MAJOR);
+    result.seconds = timeSeconds([&]() {
+        parallelFor(0, numOfFolds, 1, [&](size_t begin, size_t end) {
+            for (size_t f=begin; f<end; f++) evaluateFold(f, result.scores.col(f));
+        });
+    });
+
+    result.meanScores.assign(numOfConfigs, 0);
+    result.stdScores.assign(numOfConfigs, 0);
+    for (size_t c=0; c<numOfConfigs; c++) {
+        for (int f=0; f<numOfFolds; f++) result.meanScores[c] += result.scores(c, f) / numOfFolds;
+        for (int f=0; f<numOfFolds; f++) {
+            result.stdScores[c] += pow(result.scores(c, f) - result.meanScores[c], 2) / numOfFolds;
+        }
+        result.stdScores[c] = sqrt(result.stdScores[c]);
+        if (result.meanScores[c] > result.meanScores[result.bestConfig]) result.bestConfig = c;
+    }
+    return result;
+}
+
+inline void printCrossValidation(const CrossValidationResult &result, const std::vector<std::string> &configNames) {
+    for (size_t c=0; c<configNames.size(); c++) {
+        std::cout << (c == result.bestConfig ? "* " : "  ") << configNames[c]
+            << ": " << result.meanScores[c] << " +- " << result.stdScores[c] << std::endl;
+    }
+    std::cout << "best: " << configNames[result.bestConfig]
+        << " (" << result.meanScores[result.bestConfig] << "), "
+        << result.scores.rows() << " configurations x " << result.scores.cols()
+        << " folds in " << result.seconds << " s" << std::endl;
+}
+
+#endif
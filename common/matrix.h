@@ -0,0 +1,294 @@
+/*
+Shared contiguous matrix / dataset types
+
+Array<T>    64-byte aligned buffer, either owned or borrowed from external
+            memory (e.g. a memory-mapped file) that a keep-alive handle
+            holds valid. Copying a borrowed Array makes an owned copy.
+Matrix<T>   one Array, row-major or column-major, with a leading dimension
+            (distance between rows / columns) that is only larger than the
+            row length for borrowed, padded storage
+MatrixView  non-owning strided view (rows, columns or sub-blocks of a Matrix,
+            or any external buffer)
+Dataset     feature matrix plus a separate label array
+solveCholesky  in-place solve of a small dense symmetric positive definite
+            system (normal equations, Newton steps)
+
+rows of a row-major matrix and columns of a column-major matrix are
+contiguous, so the hot loops of the algorithms can run over raw pointers
+without copying rows around.
+*/
+
+#ifndef ML_COMMON_MATRIX_H
+#define ML_COMMON_MATRIX_H
+
+#include <cstddef>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <new>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+const size_t MATRIX_ALIGNMENT = 64;
+
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        size_t bytes = (n * sizeof(T) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+        void *p = aligned_alloc(MATRIX_ALIGNMENT, bytes);
+        if (p == nullptr) throw std::bad_alloc();
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) { free(p); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+template <typename T>
+class Array {
+public:
+    Array() = default;
+
+    explicit Array(size_t size, T value = T()) : mOwned(size, value) {
+        mData = mOwned.data();
+        mSize = size;
+    }
+
+    static Array borrow(T *data, size_t size, std::shared_ptr<const void> keepAlive) {
+        Array array;
+        array.mData = data;
+        array.mSize = size;
+        array.mKeepAlive = std::move(keepAlive);
+        return array;
+    }
+
+    Array(const Array &other) : mOwned(other.begin(), other.end()) {
+        mData = mOwned.data();
+        mSize = other.mSize;
+    }
+
+    Array(Array &&other) noexcept { swap(other); }
+
+    Array &operator=(Array other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(Array &other) noexcept {
+        mOwned.swap(other.mOwned);
+        std::swap(mData, other.mData);
+        std::swap(mSize, other.mSize);
+        mKeepAlive.swap(other.mKeepAlive);
+    }
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    bool isBorrowed() const { return mKeepAlive != nullptr; }
+
+    T *data() { return mData; }
+    const T *data() const { return mData; }
+    T &operator[](size_t i) { return mData[i]; }
+    const T &operator[](size_t i) const { return mData[i]; }
+
+    T *begin() { return mData; }
+    T *end() { return mData + mSize; }
+    const T *begin() const { return mData; }
+    const T *end() const { return mData + mSize; }
+
+private:
+    AlignedVector<T> mOwned;
+    T *mData = nullptr;
+    size_t mSize = 0;
+    std::shared_ptr<const void> mKeepAlive;
+};
+
+enum class Layout { ROW_MAJOR, COL_MAJOR };
+
+template <typename T>
+struct MatrixView {
+    T *data = nullptr;
+    size_t numOfRows = 0;
+    size_t numOfCols = 0;
+    ptrdiff_t rowStride = 0; // distance between (r, c) and (r+1, c)
+    ptrdiff_t colStride = 0; // distance between (r, c) and (r, c+1)
+
+    T &operator()(size_t r, size_t c) const { return data[r * rowStride + c * colStride]; }
+
+    // only valid when the row / column is contiguous
+    T *row(size_t r) const { assert(colStride == 1); return data + r * rowStride; }
+    T *col(size_t c) const { assert(rowStride == 1); return data + c * colStride; }
+
+    MatrixView rowRange(size_t begin, size_t end) const {
+        return {data + begin * rowStride, end - begin, numOfCols, rowStride, colStride};
+    }
+
+    MatrixView colRange(size_t begin, size_t end) const {
+        return {data + begin * colStride, numOfRows, end - begin, rowStride, colStride};
+    }
+
+    MatrixView transposed() const {
+        return {data, numOfCols, numOfRows, colStride, rowStride};
+    }
+};
+
+template <typename T>
+class Matrix {
+public:
+    Matrix() = default;
+
+    Matrix(size_t numOfRows, size_t numOfCols, Layout layout = Layout::ROW_MAJOR, T value = T())
+        : mData(numOfRows * numOfCols, value) {
+        mNumOfRows = numOfRows;
+        mNumOfCols = numOfCols;
+        mLayout = layout;
+        mLeadingDim = (layout == Layout::ROW_MAJOR) ? numOfCols : numOfRows;
+    }
+
+    // non-owning matrix over external memory, see Array::borrow
+    static Matrix borrow(T *data, size_t numOfRows, size_t numOfCols, Layout layout,
+        size_t leadingDim, std::shared_ptr<const void> keepAlive) {
+
+        Matrix matrix;
+        size_t numOfLines = (layout == Layout::ROW_MAJOR) ? numOfRows : numOfCols;
+        size_t lineSize = (layout == Layout::ROW_MAJOR) ? numOfCols : numOfRows;
+        assert(leadingDim >= lineSize);
+        size_t storageSize = (numOfLines == 0) ? 0 : (numOfLines - 1) * leadingDim + lineSize;
+        matrix.mData = Array<T>::borrow(data, storageSize, std::move(keepAlive));
+        matrix.mNumOfRows = numOfRows;
+        matrix.mNumOfCols = numOfCols;
+        matrix.mLayout = layout;
+        matrix.mLeadingDim = leadingDim;
+        return matrix;
+    }
+
+    size_t rows() const { return mNumOfRows; }
+    size_t cols() const { return mNumOfCols; }
+    size_t size() const { return mNumOfRows * mNumOfCols; }
+    Layout layout() const { return mLayout; }
+    bool empty() const { return size() == 0; }
+    size_t leadingDim() const { return mLeadingDim; }
+    bool isBorrowed() const { return mData.isBorrowed(); }
+
+    // data()[0, size()) is only the whole matrix when it is not padded
+    bool isContiguous() const { return mLeadingDim * ((mLayout == Layout::ROW_MAJOR) ? mNumOfRows : mNumOfCols) == size(); }
+    T *data() { return mData.data(); }
+    const T *data() const { return mData.data(); }
+
+    T &operator()(size_t r, size_t c) { return mData[getIndex(r, c)]; }
+    const T &operator()(size_t r, size_t c) const { return mData[getIndex(r, c)]; }
+
+    T *row(size_t r) { assert(mLayout == Layout::ROW_MAJOR); return mData.data() + r * mLeadingDim; }
+    const T *row(size_t r) const { assert(mLayout == Layout::ROW_MAJOR); return mData.data() + r * mLeadingDim; }
+    T *col(size_t c) { assert(mLayout == Layout::COL_MAJOR); return mData.data() + c * mLeadingDim; }
+    const T *col(size_t c) const { assert(mLayout == Layout::COL_MAJOR); return mData.data() + c * mLeadingDim; }
+
+    void fill(T value) {
+        if (isContiguous()) {
+            std::fill(mData.begin(), mData.begin() + size(), value);
+            return;
+        }
+        for (size_t r=0; r<mNumOfRows; r++) {
+            for (size_t c=0; c<mNumOfCols; c++) (*this)(r, c) = value;
+        }
+    }
+
+    MatrixView<T> view() {
+        return {mData.data(), mNumOfRows, mNumOfCols, getRowStride(), getColStride()};
+    }
+
+    MatrixView<const T> view() const {
+        return {mData.data(), mNumOfRows, mNumOfCols, getRowStride(), getColStride()};
+    }
+
+    Matrix toLayout(Layout layout) const {
+        Matrix result(mNumOfRows, mNumOfCols, layout);
+        for (size_t r=0; r<mNumOfRows; r++) {
+            for (size_t c=0; c<mNumOfCols; c++) result(r, c) = (*this)(r, c);
+        }
+        return result;
+    }
+
+private:
+    Array<T> mData;
+    size_t mNumOfRows = 0;
+    size_t mNumOfCols = 0;
+    Layout mLayout = Layout::ROW_MAJOR;
+    size_t mLeadingDim = 0;
+
+    ptrdiff_t getRowStride() const { return (mLayout == Layout::ROW_MAJOR) ? mLeadingDim : 1; }
+    ptrdiff_t getColStride() const { return (mLayout == Layout::ROW_MAJOR) ? 1 : mLeadingDim; }
+
+    size_t getIndex(size_t r, size_t c) const {
+        return (mLayout == Layout::ROW_MAJOR) ? r * mLeadingDim + c : c * mLeadingDim + r;
+    }
+};
+
+struct Dataset {
+    Matrix<double> features; // numOfRows x numOfFeatures, row-major unless stated otherwise
+    Array<double> labels;
+
+    Dataset() = default;
+
+    Dataset(size_t numOfRows, size_t numOfFeatures, Layout layout = Layout::ROW_MAJOR)
+        : features(numOfRows, numOfFeatures, layout), labels(numOfRows, 0) {}
+
+    size_t size() const { return labels.size(); }
+    size_t numOfFeatures() const { return features.cols(); }
+
+    double *row(size_t r) { return features.row(r); }
+    const double *row(size_t r) const { return features.row(r); }
+
+    // one-time conversion from the nested "features..., label" rows
+    static Dataset fromRows(const std::vector<std::vector<double>> &rows, Layout layout = Layout::ROW_MAJOR) {
+        size_t numOfFeatures = rows.empty() ? 0 : rows[0].size() - 1;
+        Dataset dataset(rows.size(), numOfFeatures, layout);
+        for (size_t r=0; r<rows.size(); r++) {
+            for (size_t c=0; c<numOfFeatures; c++) dataset.features(r, c) = rows[r][c];
+            dataset.labels[r] = rows[r][numOfFeatures];
+        }
+        return dataset;
+    }
+};
+
+// solves A * x = b in place for symmetric positive definite A (row-major, n x n),
+// false if A is not positive definite
+inline bool solveCholesky(std::vector<double> &A, std::vector<double> &b, int n) {
+    for (int j=0; j<n; j++) {
+        double diag = A[j * n + j];
+        for (int k=0; k<j; k++) diag -= A[j * n + k] * A[j * n + k];
+        if (diag <= 0) return false;
+        A[j * n + j] = std::sqrt(diag);
+        for (int i=j+1; i<n; i++) {
+            double value = A[i * n + j];
+            for (int k=0; k<j; k++) value -= A[i * n + k] * A[j * n + k];
+            A[i * n + j] = value / A[j * n + j];
+        }
+    }
+    // L * y = b, then L^T * x = y
+    for (int i=0; i<n; i++) {
+        for (int k=0; k<i; k++) b[i] -= A[i * n + k] * b[k];
+        b[i] /= A[i * n + i];
+    }
+    for (int i=n-1; i>=0; i--) {
+        for (int k=i+1; k<n; k++) b[i] -= A[k * n + i] * b[k];
+        b[i] /= A[i * n + i];
+    }
+    return true;
+}
+
+#endif
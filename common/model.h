@@ -0,0 +1,747 @@
+/*
+Trained models on disk, with batched prediction for serving
+
+each program writes its trained model with "./main save <path>", the
+inference server (InferenceServer/) loads any of them with Model::load and
+scores many rows per call with predictBatch:
+
+LogisticModel  probability sigmoid(b0 + sum(b_i * x_i)), coefficents bias first
+MlpModel       sigmoid layers, weights numOfInputs x numOfOutputs per layer
+               (row i holds the fan-out of input i, as in MLPWithBP)
+TreeModel      CART / Hoeffding tree flattened in preorder, leaves hold labels
+KnnModel       the train set and k, majority vote of the k nearest rows
+QuantizedMlpModel  MlpModel after post-training quantization, int8 weights
+               with a scale per output channel, uint8 activations with a
+               scale / zero point per input channel calibrated on sample
+               rows, int8 dot products (AVX-VNNI / AVX2 maddubs / scalar)
+
+file layout (little endian):
+    char[4]  magic "MLMD"
+    uint32   version (1)
+    uint32   type (ModelType)
+    uint32   numOfInputs
+    uint32   numOfOutputs
+    payload of the type, see write()
+*/
+
+#ifndef ML_COMMON_MODEL_H
+#define ML_COMMON_MODEL_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+enum class ModelType : uint32_t { LOGISTIC = 1, MLP = 2, TREE = 3, KNN = 4, MLP_INT8 = 5 };
+
+inline const char *getModelTypeName(ModelType type) {
+    switch (type) {
+        case ModelType::LOGISTIC: return "logistic";
+        case ModelType::MLP: return "mlp";
+        case ModelType::TREE: return "tree";
+        case ModelType::KNN: return "knn";
+        case ModelType::MLP_INT8: return "mlp_int8";
+    }
+    return "unknown";
+}
+
+// fread / fwrite of whole arrays, short reads are errors
+class ModelFile {
+public:
+    ModelFile(const std::string &path, const char *mode) {
+        mPath = path;
+        mFile = fopen(path.c_str(), mode);
+        if (mFile == nullptr) throw std::runtime_error("cannot open " + path);
+    }
+
+    ~ModelFile() { fclose(mFile); }
+
+    template <typename T>
+    void write(const T *values, size_t count) {
+        if (fwrite(values, sizeof(T), count, mFile) != count) throw std::runtime_error("cannot write " + mPath);
+    }
+
+    template <typename T>
+    void write(T value) { write(&value, 1); }
+
+    template <typename T>
+    void read(T *values, size_t count) {
+        if (fread(values, sizeof(T), count, mFile) != count) throw std::runtime_error("truncated model " + mPath);
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+        read(&value, 1);
+        return value;
+    }
+
+private:
+    std::string mPath;
+    FILE *mFile;
+};
+
+class Model {
+public:
+    virtual ~Model() = default;
+
+    virtual ModelType getType() const = 0;
+    size_t getNumOfInputs() const { return mNumOfInputs; }
+    size_t getNumOfOutputs() const { return mNumOfOutputs; }
+
+    // outputs[r * numOfOutputs + o] for the rows inputs[r * numOfInputs + i]
+    virtual void predictBatch(const double *inputs, size_t numOfRows, double *outputs) const = 0;
+
+    // resident size of the parameters
+    virtual size_t getNumOfBytes() const = 0;
+
+    void save(const std::string &path) const {
+        ModelFile file(path, "wb");
+        file.write("MLMD", 4);
+        file.write<uint32_t>(1);
+        file.write<uint32_t>((uint32_t)getType());
+        file.write<uint32_t>(mNumOfInputs);
+        file.write<uint32_t>(mNumOfOutputs);
+        writePayload(file);
+    }
+
+    static std::unique_ptr<Model> load(const std::string &path);
+
+protected:
+    size_t mNumOfInputs = 0;
+    size_t mNumOfOutputs = 1;
+
+    virtual void writePayload(ModelFile &file) const = 0;
+};
+
+// rows per task of the batched kernels
+const size_t MODEL_GRAIN_ROWS = 64;
+
+class LogisticModel : public Model {
+public:
+    LogisticModel(const std::vector<double> &coefficents) {
+        mCoefficents = coefficents;
+        mNumOfInputs = coefficents.size() - 1;
+    }
+
+    ModelType getType() const override { return ModelType::LOGISTIC; }
+
+    void predictBatch(const double *inputs, size_t numOfRows, double *outputs) const override {
+        parallelFor(0, numOfRows, MODEL_GRAIN_ROWS * 16, [&](size_t begin, size_t end) {
+            for (size_t r=begin; r<end; r++) {
+                const double *x = inputs + r * mNumOfInputs;
+                double z = mCoefficents[0];
+                for (size_t i=0; i<mNumOfInputs; i++) z += mCoefficents[i+1] * x[i];
+                outputs[r] = 1.0 / (1.0 + exp(-z));
+            }
+        });
+    }
+
+    size_t getNumOfBytes() const override { return mCoefficents.size() * sizeof(double); }
+
+    static std::unique_ptr<Model> read(ModelFile &file, size_t numOfInputs) {
+        std::vector<double> coefficents(numOfInputs + 1);
+        file.read(coefficents.data(), coefficents.size());
+        return std::unique_ptr<Model>(new LogisticModel(coefficents));
+    }
+
+private:
+    std::vector<double> mCoefficents;
+
+    // double coefficents[numOfInputs + 1]
+    void writePayload(ModelFile &file) const override {
+        file.write(mCoefficents.data(), mCoefficents.size());
+    }
+};
+
+struct MlpLayer {
+    Matrix<double> weights; // numOfInputs x numOfOutputs
+    std::vector<double> biases;
+};
+
+class MlpModel : public Model {
+public:
+    MlpModel(const std::vector<MlpLayer> &layers) {
+        mLayers = layers;
+        mNumOfInputs = layers.front().weights.rows();
+        mNumOfOutputs = layers.back().weights.cols();
+    }
+
+    ModelType getType() const override { return ModelType::MLP; }
+    const std::vector<MlpLayer> &getLayers() const { return mLayers; }
+
+    /**
+     * sigmoid(activations * weights + biases) of numOfRows contiguous rows
+     * into outputs, each weight row is loaded once per block instead of once
+     * per row
+     */
+    static void forwardLayer(const MlpLayer &layer, const double *activations, size_t numOfRows, double *outputs) {
+        size_t numOfLayerInputs = layer.weights.rows();
+        size_t numOfLayerOutputs = layer.weights.cols();
+        for (size_t r=0; r<numOfRows; r++) {
+            std::copy(layer.biases.begin(), layer.biases.end(), outputs + r * numOfLayerOutputs);
+        }
+        for (size_t i=0; i<numOfLayerInputs; i++) {
+            const double *weightRow = layer.weights.row(i);
+            for (size_t r=0; r<numOfRows; r++) {
+                double x = activations[r * numOfLayerInputs + i];
+                double *z = outputs + r * numOfLayerOutputs;
+                for (size_t j=0; j<numOfLayerOutputs; j++) z[j] += weightRow[j] * x;
+            }
+        }
+        for (size_t k=0; k<numOfRows * numOfLayerOutputs; k++) outputs[k] = 1.0 / (1.0 + exp(-outputs[k]));
+    }
+
+    static Matrix<double> forwardLayer(const MlpLayer &layer, const Matrix<double> &activations) {
+        Matrix<double> outputs(activations.rows(), layer.weights.cols());
+        forwardLayer(layer, activations.data(), activations.rows(), outputs.data());
+        return outputs;
+    }
+
+    /**
+     * the hidden activations of a chunk ping-pong between two per-thread
+     * buffers that are reused across calls, the first layer reads the inputs
+     * and the last one writes the outputs in place
+     */
+    void predictBatch(const double *inputs, size_t numOfRows, double *outputs) const override {
+        parallelFor(0, numOfRows, MODEL_GRAIN_ROWS, [&](size_t begin, size_t end) {
+            thread_local std::vector<double> buffers[2];
+            size_t numOfChunkRows = end - begin;
+            const double *activations = inputs + begin * mNumOfInputs;
+            for (size_t l=0; l<mLayers.size(); l++) {
+                double *layerOutputs = outputs + begin * mNumOfOutputs;
+                if (l + 1 < mLayers.size()) {
+                    std::vector<double> &buffer = buffers[l % 2];
+                    buffer.resize(numOfChunkRows * mLayers[l].weights.cols());
+                    layerOutputs = buffer.data();
+                }
+                forwardLayer(mLayers[l], activations, numOfChunkRows, layerOutputs);
+                activations = layerOutputs;
+            }
+        });
+    }
+
+    size_t getNumOfBytes() const override {
+        size_t numOfBytes = 0;
+        for (const auto &layer : mLayers) numOfBytes += (layer.weights.size() + layer.biases.size()) * sizeof(double);
+        return numOfBytes;
+    }
+
+    static std::unique_ptr<Model> read(ModelFile &file, size_t numOfModelInputs) {
+        std::vector<MlpLayer> layers(file.read<uint32_t>());
+        // every layer takes the outputs of the one before, the first the model inputs
+        size_t numOfLayerInputs = numOfModelInputs;
+        for (auto &layer : layers) {
+            uint32_t numOfInputs = file.read<uint32_t>();
+            uint32_t numOfOutputs = file.read<uint32_t>();
+            if (numOfInputs != numOfLayerInputs) throw std::runtime_error("mlp layer shapes do not match");
+            numOfLayerInputs = numOfOutputs;
+            layer.weights = Matrix<double>(numOfInputs, numOfOutputs);
+            layer.biases.resize(numOfOutputs);
+            file.read(layer.weights.data(), layer.weights.size());
+            file.read(layer.biases.data(), numOfOutputs);
+        }
+        if (layers.empty()) throw std::runtime_error("mlp model without layers");
+        return std::unique_ptr<Model>(new MlpModel(layers));
+    }
+
+private:
+    std::vector<MlpLayer> mLayers;
+
+    // uint32 numOfLayers, per layer: uint32 in, uint32 out, double weights[in * out], double biases[out]
+    void writePayload(ModelFile &file) const override {
+        file.write<uint32_t>(mLayers.size());
+        for (const auto &layer : mLayers) {
+            file.write<uint32_t>(layer.weights.rows());
+            file.write<uint32_t>(layer.weights.cols());
+            file.write(layer.weights.data(), layer.weights.size());
+            file.write(layer.biases.data(), layer.biases.size());
+        }
+    }
+};
+
+// label != -1 marks a leaf, left / right are node indices (-1 = none)
+struct TreeModelNode {
+    int32_t featureIdx;
+    int32_t left;
+    int32_t right;
+    double featureValue;
+    double label;
+};
+
+class TreeModel : public Model {
+public:
+    TreeModel(const std::vector<TreeModelNode> &nodes, size_t numOfInputs) {
+        mNodes = nodes;
+        mNumOfInputs = numOfInputs;
+    }
+
+    ModelType getType() const override { return ModelType::TREE; }
+
+    // same descent as predict() in RegressionTrees, -1 where a child is missing
+    void predictBatch(const double *inputs, size_t numOfRows, double *outputs) const override {
+        parallelFor(0, numOfRows, MODEL_GRAIN_ROWS * 16, [&](size_t begin, size_t end) {
+            for (size_t r=begin; r<end; r++) {
+                const double *x = inputs + r * mNumOfInputs;
+                int node = 0;
+                while (node >= 0 && mNodes[node].label == -1) {
+                    const TreeModelNode &n = mNodes[node];
+                    node = (x[n.featureIdx] < n.featureValue) ? n.left : n.right;
+                }
+                outputs[r] = (node >= 0) ? mNodes[node].label : -1;
+            }
+        });
+    }
+
+    size_t getNumOfBytes() const override { return mNodes.size() * sizeof(TreeModelNode); }
+
+    static std::unique_ptr<Model> read(ModelFile &file, size_t numOfInputs) {
+        std::vector<TreeModelNode> nodes(file.read<uint32_t>());
+        for (auto &node : nodes) {
+            node.featureIdx = file.read<int32_t>();
+            node.left = file.read<int32_t>();
+            node.right = file.read<int32_t>();
+            node.featureValue = file.read<double>();
+            node.label = file.read<double>();
+            bool isValid = (node.label != -1) || (node.featureIdx >= 0 && node.featureIdx < (int32_t)numOfInputs);
+            if (!isValid || node.left >= (int32_t)nodes.size() || node.right >= (int32_t)nodes.size()) {
+                throw std::runtime_error("bad tree node");
+            }
+        }
+        if (nodes.empty()) throw std::runtime_error("tree model without nodes");
+        return std::unique_ptr<Model>(new TreeModel(nodes, numOfInputs));
+    }
+
+private:
+    std::vector<TreeModelNode> mNodes;
+
+    // uint32 numOfNodes, per node: int32 featureIdx, left, right, double featureValue, label
+    void writePayload(ModelFile &file) const override {
+        file.write<uint32_t>(mNodes.size());
+        for (const auto &node : mNodes) {
+            file.write(node.featureIdx);
+            file.write(node.left);
+            file.write(node.right);
+            file.write(node.featureValue);
+            file.write(node.label);
+        }
+    }
+};
+
+class KnnModel : public Model {
+public:
+    // trainSet is copied into a column-major layout
+    KnnModel(const Dataset &trainSet, int numOfNeighbors) {
+        mTrainSet.features = trainSet.features.toLayout(Layout::COL_MAJOR);
+        mTrainSet.labels = trainSet.labels;
+        mNumOfNeighbors = std::min<size_t>(numOfNeighbors, trainSet.size());
+        mNumOfInputs = trainSet.numOfFeatures();
+    }
+
+    ModelType getType() const override { return ModelType::KNN; }
+
+    /**
+     * the train set is scanned in blocks, and each block is compared with
+     * every query of a task while it is in cache, so a batch reads the train
+     * set once per task instead of once per query. Within a block the
+     * distances are summed one column at a time, independent rows side by side.
+     * Small batches have fewer query tasks than threads, so the train set is
+     * also cut into parts: every (queries, part) task keeps its own k nearest,
+     * and the parts are merged per query before the vote.
+     */
+    void predictBatch(const double *inputs, size_t numOfRows, double *outputs) const override {
+        const size_t queryGrain = 8;
+        size_t numOfQueryTasks = (numOfRows + queryGrain - 1) / queryGrain;
+        size_t numOfBlocks = (mTrainSet.size() + KNN_BLOCK_ROWS - 1) / KNN_BLOCK_ROWS;
+        size_t numOfThreads = ThreadPool::getGlobal().getNumOfThreads();
+        size_t numOfParts = std::max<size_t>(1, std::min(numOfBlocks, (numOfThreads + numOfQueryTasks - 1) / numOfQueryTasks));
+        size_t blocksPerPart = (numOfBlocks + numOfParts - 1) / numOfParts;
+
+        // nearest[part * numOfRows + q], a max-heap of the k nearest (distance, row) of the part
+        std::vector<std::vector<std::pair<double, int>>> nearest(numOfParts * numOfRows);
+        parallelFor(0, numOfQueryTasks * numOfParts, 1, [&](size_t taskBegin, size_t taskEnd) {
+            for (size_t task=taskBegin; task<taskEnd; task++) {
+                size_t part = task % numOfParts;
+                size_t begin = (task / numOfParts) * queryGrain;
+                size_t end = std::min(numOfRows, begin + queryGrain);
+                size_t trainBegin = std::min(mTrainSet.size(), part * blocksPerPart * KNN_BLOCK_ROWS);
+                size_t trainEnd = std::min(mTrainSet.size(), trainBegin + blocksPerPart * KNN_BLOCK_ROWS);
+                scanTrainRows(inputs, begin, end, trainBegin, trainEnd, nearest.data() + part * numOfRows);
+            }
+        });
+        for (size_t q=0; q<numOfRows; q++) {
+            std::vector<std::pair<double, int>> &heap = nearest[q];
+            for (size_t part=1; part<numOfParts; part++) {
+                for (auto &candidate : nearest[part * numOfRows + q]) pushCandidate(heap, candidate);
+            }
+            outputs[q] = vote(heap);
+        }
+    }
+
+    size_t getNumOfBytes() const override {
+        return (mTrainSet.features.size() + mTrainSet.labels.size()) * sizeof(double);
+    }
+
+    static std::unique_ptr<Model> read(ModelFile &file, size_t numOfInputs) {
+        uint32_t numOfNeighbors = file.read<uint32_t>();
+        uint64_t numOfRows = file.read<uint64_t>();
+        Dataset trainSet(numOfRows, numOfInputs, Layout::COL_MAJOR);
+        file.read(trainSet.features.data(), trainSet.features.size());
+        file.read(trainSet.labels.data(), numOfRows);
+        return std::unique_ptr<Model>(new KnnModel(trainSet, numOfNeighbors));
+    }
+
+private:
+    static constexpr size_t KNN_BLOCK_ROWS = 256;
+    // queries compared with one train block at a time
+    static constexpr size_t KNN_QUERY_TILE = 4;
+
+    Dataset mTrainSet; // column-major
+    size_t mNumOfNeighbors;
+
+    // keeps the k smallest (distance, row) pairs, ties broken by row
+    void pushCandidate(std::vector<std::pair<double, int>> &heap, const std::pair<double, int> &candidate) const {
+        if (heap.size() < mNumOfNeighbors) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (candidate < heap.front()) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    /**
+     * distances[j * KNN_BLOCK_ROWS + r] = |train row blockBegin + r - queries[j]|^2
+     * for NUM_OF_QUERIES queries at once: every train value that is loaded is
+     * compared with all of them, the sums of 4 rows per query stay in registers
+     */
+    template <int NUM_OF_QUERIES>
+    void getBlockDistances(const double *const *queries, size_t blockBegin, size_t numOfBlockRows, double *distances) const {
+        size_t r = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        for (; r+4<=numOfBlockRows; r+=4) {
+            __m256d sums[NUM_OF_QUERIES];
+            for (int j=0; j<NUM_OF_QUERIES; j++) sums[j] = _mm256_setzero_pd();
+            for (size_t i=0; i<mNumOfInputs; i++) {
+                __m256d values = _mm256_loadu_pd(mTrainSet.features.col(i) + blockBegin + r);
+                for (int j=0; j<NUM_OF_QUERIES; j++) {
+                    __m256d diffs = _mm256_sub_pd(values, _mm256_broadcast_sd(queries[j] + i));
+                    sums[j] = _mm256_fmadd_pd(diffs, diffs, sums[j]);
+                }
+            }
+            for (int j=0; j<NUM_OF_QUERIES; j++) _mm256_storeu_pd(distances + j * KNN_BLOCK_ROWS + r, sums[j]);
+        }
+#endif
+        for (; r<numOfBlockRows; r++) {
+            for (int j=0; j<NUM_OF_QUERIES; j++) {
+                double sum = 0;
+                for (size_t i=0; i<mNumOfInputs; i++) {
+                    double diff = mTrainSet.features.col(i)[blockBegin + r] - queries[j][i];
+                    sum += diff * diff;
+                }
+                distances[j * KNN_BLOCK_ROWS + r] = sum;
+            }
+        }
+    }
+
+    // the k nearest of train rows [trainBegin, trainEnd) for the queries [begin, end) into nearest[q]
+    void scanTrainRows(const double *inputs, size_t begin, size_t end, size_t trainBegin, size_t trainEnd,
+        std::vector<std::pair<double, int>> *nearest) const {
+
+        double distances[KNN_QUERY_TILE * KNN_BLOCK_ROWS];
+        for (size_t blockBegin=trainBegin; blockBegin<trainEnd; blockBegin+=KNN_BLOCK_ROWS) {
+            size_t numOfBlockRows = std::min(trainEnd - blockBegin, KNN_BLOCK_ROWS);
+            for (size_t tileBegin=begin; tileBegin<end; tileBegin+=KNN_QUERY_TILE) {
+                size_t numOfTileQueries = std::min(end - tileBegin, KNN_QUERY_TILE);
+                const double *queries[KNN_QUERY_TILE];
+                for (size_t j=0; j<numOfTileQueries; j++) queries[j] = inputs + (tileBegin + j) * mNumOfInputs;
+                switch (numOfTileQueries) {
+                    case 1: getBlockDistances<1>(queries, blockBegin, numOfBlockRows, distances); break;
+                    case 2: getBlockDistances<2>(queries, blockBegin, numOfBlockRows, distances); break;
+                    case 3: getBlockDistances<3>(queries, blockBegin, numOfBlockRows, distances); break;
+                    default: getBlockDistances<4>(queries, blockBegin, numOfBlockRows, distances); break;
+                }
+                for (size_t j=0; j<numOfTileQueries; j++) {
+                    const double *queryDistances = distances + j * KNN_BLOCK_ROWS;
+                    auto &heap = nearest[tileBegin + j];
+                    // farthest of the k so far, rows beyond it are skipped without touching the heap
+                    double bound = (heap.size() < mNumOfNeighbors) ? DBL_MAX : heap.front().first;
+                    for (size_t r=0; r<numOfBlockRows; r++) {
+                        if (queryDistances[r] > bound) continue;
+                        pushCandidate(heap, {queryDistances[r], (int)(blockBegin + r)});
+                        if (heap.size() == mNumOfNeighbors) bound = heap.front().first;
+                    }
+                }
+            }
+        }
+    }
+
+    // most frequent label, ties go to the label that reached the count with nearer rows
+    double vote(std::vector<std::pair<double, int>> &heap) const {
+        std::sort(heap.begin(), heap.end());
+        std::vector<std::pair<double, int>> counts; // (label, count)
+        double bestLabel = -1;
+        int bestCount = 0;
+        for (auto &item : heap) {
+            double label = mTrainSet.labels[item.second];
+            auto it = std::find_if(counts.begin(), counts.end(),
+                [&](const std::pair<double, int> &count) { return count.first == label; });
+            if (it == counts.end()) it = counts.insert(counts.end(), {label, 0});
+            if (++it->second > bestCount) {
+                bestCount = it->second;
+                bestLabel = label;
+            }
+        }
+        return bestLabel;
+    }
+
+    // uint32 k, uint64 numOfRows, double features[numOfInputs * numOfRows] (column-major), double labels[numOfRows]
+    void writePayload(ModelFile &file) const override {
+        file.write<uint32_t>(mNumOfNeighbors);
+        file.write<uint64_t>(mTrainSet.size());
+        file.write(mTrainSet.features.data(), mTrainSet.features.size());
+        file.write(mTrainSet.labels.data(), mTrainSet.size());
+    }
+};
+
+/**
+ * activations are quantized to [0, QUANTIZED_ACTIVATION_MAX], 7 bits: the two
+ * u8 * s8 products maddubs adds into one int16 lane then cannot saturate
+ * (2 * 127 * 127 < 32767), so all kernels give the same sums
+ */
+const int QUANTIZED_ACTIVATION_MAX = 127;
+// int8 rows are padded with zeros to whole 32-byte vectors
+const size_t QUANTIZED_ROW_ALIGNMENT = 32;
+
+// sum of a[i] * b[i], n a multiple of QUANTIZED_ROW_ALIGNMENT
+inline int32_t dotU8S8(const uint8_t *a, const int8_t *b, size_t n) {
+    size_t i = 0;
+    int32_t sum = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+#if !defined(__AVXVNNI__) && !(defined(__AVX512VNNI__) && defined(__AVX512VL__))
+    const __m256i ones = _mm256_set1_epi16(1);
+#endif
+    for (; i+32<=n; i+=32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(b + i));
+#if defined(__AVXVNNI__)
+        acc = _mm256_dpbusd_avx_epi32(acc, x, w);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+        acc = _mm256_dpbusd_epi32(acc, x, w);
+#else
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+#endif
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    sum = _mm_cvtsi128_si32(half);
+#endif
+    for (; i<n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+
+// x_i ~ inputScales[i] * (q_i - inputZeros[i]), output j ~ weightScales[j] * sum(q_i * weights(j, i)) + offsets[j]
+struct QuantizedMlpLayer {
+    size_t numOfInputs = 0;
+    size_t numOfOutputs = 0;
+    size_t numOfPaddedInputs = 0;
+    std::vector<float> inputScales;
+    std::vector<uint8_t> inputZeros;
+    std::vector<int8_t, AlignedAllocator<int8_t>> weights; // numOfOutputs x numOfPaddedInputs
+    std::vector<float> weightScales;
+    std::vector<float> offsets; // bias - weightScale * sum(inputZeros[i] * weights(j, i))
+
+    // the padding of quantized is left alone
+    void quantizeRow(const double *x, uint8_t *quantized) const {
+        for (size_t i=0; i<numOfInputs; i++) {
+            double q = nearbyint(x[i] / inputScales[i]) + inputZeros[i];
+            quantized[i] = (uint8_t)std::min<double>(std::max<double>(q, 0), QUANTIZED_ACTIVATION_MAX);
+        }
+    }
+
+    void resize(size_t numOfLayerInputs, size_t numOfLayerOutputs) {
+        numOfInputs = numOfLayerInputs;
+        numOfOutputs = numOfLayerOutputs;
+        numOfPaddedInputs = (numOfInputs + QUANTIZED_ROW_ALIGNMENT - 1) / QUANTIZED_ROW_ALIGNMENT * QUANTIZED_ROW_ALIGNMENT;
+        inputScales.assign(numOfInputs, 1);
+        inputZeros.assign(numOfInputs, 0);
+        weights.assign(numOfOutputs * numOfPaddedInputs, 0);
+        weightScales.assign(numOfOutputs, 1);
+        offsets.assign(numOfOutputs, 0);
+    }
+};
+
+class QuantizedMlpModel : public Model {
+public:
+    QuantizedMlpModel(const std::vector<QuantizedMlpLayer> &layers) {
+        mLayers = layers;
+        mNumOfInputs = layers.front().numOfInputs;
+        mNumOfOutputs = layers.back().numOfOutputs;
+    }
+
+    /**
+     * post-training quantization, sample holds numOfRows calibration rows.
+     * The range of every input channel of every layer over the sample
+     * (widened to contain 0) gives its scale and zero point. The input scales
+     * are folded into the weights, which are then rounded to int8 with one
+     * scale per output channel; the zero points go into the offsets.
+     */
+    static QuantizedMlpModel quantize(const MlpModel &model, const double *sample, size_t numOfRows) {
+        Matrix<double> activations(numOfRows, model.getNumOfInputs());
+        std::copy(sample, sample + activations.size(), activations.data());
+        std::vector<QuantizedMlpLayer> layers;
+        for (const MlpLayer &layer : model.getLayers()) {
+            layers.push_back(quantizeLayer(layer, activations));
+            activations = MlpModel::forwardLayer(layer, activations);
+        }
+        return QuantizedMlpModel(layers);
+    }
+
+    ModelType getType() const override { return ModelType::MLP_INT8; }
+
+    // one row at a time through all layers, the int8 weights of a layer stay in L1
+    void predictBatch(const double *inputs, size_t numOfRows, double *outputs) const override {
+        parallelFor(0, numOfRows, MODEL_GRAIN_ROWS, [&](size_t begin, size_t end) {
+            std::vector<uint8_t, AlignedAllocator<uint8_t>> quantized;
+            std::vector<double> activations, nextActivations;
+            for (size_t r=begin; r<end; r++) {
+                const double *x = inputs + r * mNumOfInputs;
+                for (const QuantizedMlpLayer &layer : mLayers) {
+                    quantized.assign(layer.numOfPaddedInputs, 0);
+                    layer.quantizeRow(x, quantized.data());
+                    nextActivations.resize(layer.numOfOutputs);
+                    for (size_t j=0; j<layer.numOfOutputs; j++) {
+                        int32_t sum = dotU8S8(quantized.data(),
+                            layer.weights.data() + j * layer.numOfPaddedInputs, layer.numOfPaddedInputs);
+                        nextActivations[j] = 1.0 / (1.0 + exp(-(layer.weightScales[j] * sum + layer.offsets[j])));
+                    }
+                    activations.swap(nextActivations);
+                    x = activations.data();
+                }
+                std::copy(activations.begin(), activations.end(), outputs + r * mNumOfOutputs);
+            }
+        });
+    }
+
+    size_t getNumOfBytes() const override {
+        size_t numOfBytes = 0;
+        for (const auto &layer : mLayers) {
+            numOfBytes += layer.weights.size() + layer.inputZeros.size()
+                + (layer.inputScales.size() + layer.weightScales.size() + layer.offsets.size()) * sizeof(float);
+        }
+        return numOfBytes;
+    }
+
+    static std::unique_ptr<Model> read(ModelFile &file, size_t numOfModelInputs) {
+        std::vector<QuantizedMlpLayer> layers(file.read<uint32_t>());
+        // every layer takes the outputs of the one before, the first the model inputs
+        size_t numOfLayerInputs = numOfModelInputs;
+        for (auto &layer : layers) {
+            uint32_t numOfInputs = file.read<uint32_t>();
+            uint32_t numOfOutputs = file.read<uint32_t>();
+            if (numOfInputs != numOfLayerInputs) throw std::runtime_error("quantized mlp layer shapes do not match");
+            numOfLayerInputs = numOfOutputs;
+            layer.resize(numOfInputs, numOfOutputs);
+            file.read(layer.inputScales.data(), numOfInputs);
+            file.read(layer.inputZeros.data(), numOfInputs);
+            file.read(layer.weightScales.data(), numOfOutputs);
+            file.read(layer.offsets.data(), numOfOutputs);
+            for (size_t j=0; j<numOfOutputs; j++) {
+                file.read(layer.weights.data() + j * layer.numOfPaddedInputs, numOfInputs);
+            }
+        }
+        if (layers.empty()) throw std::runtime_error("quantized mlp model without layers");
+        return std::unique_ptr<Model>(new QuantizedMlpModel(layers));
+    }
+
+private:
+    std::vector<QuantizedMlpLayer> mLayers;
+
+    static QuantizedMlpLayer quantizeLayer(const MlpLayer &layer, const Matrix<double> &sample) {
+        QuantizedMlpLayer quantized;
+        quantized.resize(layer.weights.rows(), layer.weights.cols());
+        for (size_t i=0; i<quantized.numOfInputs; i++) {
+            double low = 0, high = 0;
+            for (size_t r=0; r<sample.rows(); r++) {
+                low = std::min(low, sample(r, i));
+                high = std::max(high, sample(r, i));
+            }
+            if (high > low) quantized.inputScales[i] = (high - low) / QUANTIZED_ACTIVATION_MAX;
+            quantized.inputZeros[i] = (uint8_t)std::min<double>(
+                nearbyint(-low / quantized.inputScales[i]), QUANTIZED_ACTIVATION_MAX);
+        }
+        for (size_t j=0; j<quantized.numOfOutputs; j++) {
+            double maxAbs = 0;
+            for (size_t i=0; i<quantized.numOfInputs; i++) {
+                maxAbs = std::max(maxAbs, std::abs(quantized.inputScales[i] * layer.weights(i, j)));
+            }
+            if (maxAbs > 0) quantized.weightScales[j] = maxAbs / 127;
+            int8_t *weightRow = quantized.weights.data() + j * quantized.numOfPaddedInputs;
+            int64_t zeroSum = 0;
+            for (size_t i=0; i<quantized.numOfInputs; i++) {
+                double w = quantized.inputScales[i] * layer.weights(i, j) / quantized.weightScales[j];
+                weightRow[i] = (int8_t)std::min<double>(std::max<double>(nearbyint(w), -127), 127);
+                zeroSum += quantized.inputZeros[i] * weightRow[i];
+            }
+            quantized.offsets[j] = layer.biases[j] - quantized.weightScales[j] * zeroSum;
+        }
+        return quantized;
+    }
+
+    /**
+     * uint32 numOfLayers, per layer: uint32 in, uint32 out, float inputScales[in],
+     * uint8 inputZeros[in], float weightScales[out], float offsets[out], int8 weights[out * in]
+     */
+    void writePayload(ModelFile &file) const override {
+        file.write<uint32_t>(mLayers.size());
+        for (const auto &layer : mLayers) {
+            file.write<uint32_t>(layer.numOfInputs);
+            file.write<uint32_t>(layer.numOfOutputs);
+            file.write(layer.inputScales.data(), layer.numOfInputs);
+            file.write(layer.inputZeros.data(), layer.numOfInputs);
+            file.write(layer.weightScales.data(), layer.numOfOutputs);
+            file.write(layer.offsets.data(), layer.numOfOutputs);
+            for (size_t j=0; j<layer.numOfOutputs; j++) {
+                file.write(layer.weights.data() + j * layer.numOfPaddedInputs, layer.numOfInputs);
+            }
+        }
+    }
+};
+
+inline std::unique_ptr<Model> Model::load(const std::string &path) {
+    ModelFile file(path, "rb");
+    char magic[4];
+    file.read(magic, 4);
+    if (memcmp(magic, "MLMD", 4) != 0) throw std::runtime_error(path + " is not a model file");
+    if (file.read<uint32_t>() != 1) throw std::runtime_error("unsupported model version in " + path);
+    ModelType type = (ModelType)file.read<uint32_t>();
+    size_t numOfInputs = file.read<uint32_t>();
+    file.read<uint32_t>(); // numOfOutputs, implied by the payload
+    switch (type) {
+        case ModelType::LOGISTIC: return LogisticModel::read(file, numOfInputs);
+        case ModelType::MLP: return MlpModel::read(file, numOfInputs);
+        case ModelType::TREE: return TreeModel::read(file, numOfInputs);
+        case ModelType::KNN: return KnnModel::read(file, numOfInputs);
+        case ModelType::MLP_INT8: return QuantizedMlpModel::read(file, numOfInputs);
+    }
+    throw std::runtime_error("unknown model type in " + path);
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+Hot-path profiling with hardware counters
+
+built with -DML_PROFILE (make profile), every named region reports wall time,
+cycles, instructions, L1D read misses, LLC misses and branch misses, read from
+per-thread linux perf_event_open counters around each entry of the region.
+Algorithm counters (distance evaluations, split candidates, samples, ...)
+are plain relaxed atomics. At exit the report is written as JSON to
+$ML_PROFILE_OUT (default profile.json).
+
+void assign(...) {
+    PERF_REGION("kmeans.assign");
+    ...
+    PERF_COUNT("kmeans.distanceEvaluations", numOfPoints * k);
+}
+
+without ML_PROFILE both macros expand to nothing, so a normal build carries
+no overhead. Regions inside parallel loops should wrap one chunk, then the
+counters of whichever worker runs it are read. Each region entry costs two
+read() system calls, so chunks should be much larger than that.
+
+without perf access (e.g. kernel.perf_event_paranoid > 2, containers) only
+wall time and the algorithm counters are reported, hardware fields are null.
+*/
+
+#ifndef ML_COMMON_PERF_H
+#define ML_COMMON_PERF_H
+
+#ifdef ML_PROFILE
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+enum PerfEvent { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, NUM_OF_PERF_EVENTS };
+
+const char *const PERF_EVENT_NAMES[NUM_OF_PERF_EVENTS] = {
+    "cycles", "instructions", "l1dMisses", "llcMisses", "branchMisses"
+};
+
+/**
+ * one counter group of the calling thread, opened on first use and closed
+ * when the thread exits. Events the cpu / kernel refuse are left out.
+ */
+class PerfCounters {
+public:
+    PerfCounters() {
+#ifdef __linux__
+        const uint64_t configs[NUM_OF_PERF_EVENTS][2] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        for (int e=0; e<NUM_OF_PERF_EVENTS; e++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = configs[e][0];
+            attr.config = configs[e][1];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            // this thread on any cpu, grouped so all events count the same instructions
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, mLeaderFd, 0);
+            if (fd < 0) continue;
+            if (mLeaderFd < 0) mLeaderFd = fd;
+            mFds.push_back(fd);
+            mEvents.push_back(e);
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : mFds) close(fd);
+#endif
+    }
+
+    static PerfCounters &getThreadLocal() {
+        static thread_local PerfCounters counters;
+        return counters;
+    }
+
+    bool isAvailable() const { return mLeaderFd >= 0; }
+
+    // values[e] of every event, events that are not counted stay 0
+    void read(uint64_t values[NUM_OF_PERF_EVENTS]) const {
+        memset(values, 0, NUM_OF_PERF_EVENTS * sizeof(uint64_t));
+#ifdef __linux__
+        if (mLeaderFd < 0) return;
+        uint64_t buffer[1 + NUM_OF_PERF_EVENTS];
+        if (::read(mLeaderFd, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t)) return;
+        for (uint64_t i=0; i<buffer[0] && i<mEvents.size(); i++) values[mEvents[i]] = buffer[1 + i];
+#endif
+    }
+
+    // bit e is set when event e is counted
+    unsigned getEventMask() const {
+        unsigned mask = 0;
+        for (int e : mEvents) mask |= 1u << e;
+        return mask;
+    }
+
+private:
+    int mLeaderFd = -1;
+    std::vector<int> mFds;
+    std::vector<int> mEvents;
+};
+
+struct ProfileRegion {
+    std::string name;
+    std::mutex mutex;
+    uint64_t numOfCalls = 0;
+    double seconds = 0; // summed over threads
+    uint64_t values[NUM_OF_PERF_EVENTS] = {0};
+    unsigned eventMask = 0; // events counted on every thread that entered the region
+};
+
+class Profiler {
+public:
+    // the report is written when the process exits
+    ~Profiler() { write(); }
+
+    static Profiler &get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // registered once per call site, the reference stays valid
+    ProfileRegion &getRegion(const char *name) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto &region : mRegions) {
+            if (region->name == name) return *region;
+        }
+        mRegions.emplace_back(new ProfileRegion);
+        mRegions.back()->name = name;
+        return *mRegions.back();
+    }
+
+    std::atomic<uint64_t> &getCounter(const char *name) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto &counter : mCounters) {
+            if (counter.first == name) return *counter.second;
+        }
+        mCounters.emplace_back(name, std::unique_ptr<std::atomic<uint64_t>>(new std::atomic<uint64_t>(0)));
+        return *mCounters.back().second;
+    }
+
+    void write() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRegions.empty() && mCounters.empty()) return;
+        const char *path = getenv("ML_PROFILE_OUT");
+        if (path == nullptr || *path == '\0') path = "profile.json";
+
+        bool isPerfAvailable = false;
+        for (auto &region : mRegions) isPerfAvailable |= (region->eventMask != 0);
+        std::ofstream file(path);
+        if (!file) fail(std::string("cannot open ") + path);
+        file << "{\n  \"perfAvailable\": " << (isPerfAvailable ? "true" : "false") << ",\n"
+            << "  \"regions\": [";
+        for (size_t r=0; r<mRegions.size(); r++) {
+            ProfileRegion &region = *mRegions[r];
+            std::lock_guard<std::mutex> regionLock(region.mutex);
+            file << (r > 0 ? "," : "") << "\n    {\"name\": \"" << region.name << "\""
+                << ", \"calls\": " << region.numOfCalls
+                << ", \"seconds\": " << formatNumber(region.seconds);
+            for (int e=0; e<NUM_OF_PERF_EVENTS; e++) {
+                file << ", \"" << PERF_EVENT_NAMES[e] << "\": "
+                    << ((region.eventMask & (1u << e)) ? std::to_string(region.values[e]) : "null");
+            }
+            unsigned ipcMask = (1u << PERF_CYCLES) | (1u << PERF_INSTRUCTIONS);
+            bool hasIpc = (region.eventMask & ipcMask) == ipcMask && region.values[PERF_CYCLES] > 0;
+            file << ", \"ipc\": " << (hasIpc
+                ? formatNumber((double)region.values[PERF_INSTRUCTIONS] / region.values[PERF_CYCLES]) : "null")
+                << "}";
+        }
+        file << (mRegions.empty() ? "" : "\n  ") << "],\n  \"counters\": {";
+        for (size_t c=0; c<mCounters.size(); c++) {
+            file << (c > 0 ? "," : "") << "\n    \"" << mCounters[c].first << "\": "
+                << mCounters[c].second->load(std::memory_order_relaxed);
+        }
+        file << (mCounters.empty() ? "" : "\n  ") << "}\n}\n";
+        file.close();
+        if (!file) fail(std::string("cannot write ") + path);
+        std::cout << "profile written to " << path
+            << (isPerfAvailable ? "" : " (no perf_event access, wall time only)") << std::endl;
+    }
+
+private:
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<ProfileRegion>> mRegions;
+
+    // write() runs from a static destructor at exit, where neither throwing
+    // nor exit() is allowed, so the process ends here with a failure status
+    static void fail(const std::string &message) {
+        std::cout.flush();
+        std::cerr << "profiler: " << message << std::endl;
+        std::_Exit(1);
+    }
+    std::vector<std::pair<std::string, std::unique_ptr<std::atomic<uint64_t>>>> mCounters;
+
+    static std::string formatNumber(double value) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.6g", value);
+        return buffer;
+    }
+};
+
+// counts the calling thread from construction to destruction
+class ProfileScope {
+public:
+    ProfileScope(ProfileRegion &region) : mRegion(region), mCounters(PerfCounters::getThreadLocal()) {
+        mStart = std::chrono::steady_clock::now();
+        mCounters.read(mStartValues);
+    }
+
+    ~ProfileScope() {
+        uint64_t endValues[NUM_OF_PERF_EVENTS];
+        mCounters.read(endValues);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+        std::lock_guard<std::mutex> lock(mRegion.mutex);
+        mRegion.eventMask = (mRegion.numOfCalls == 0) ? mCounters.getEventMask() : mRegion.eventMask & mCounters.getEventMask();
+        mRegion.numOfCalls++;
+        mRegion.seconds += seconds;
+        for (int e=0; e<NUM_OF_PERF_EVENTS; e++) mRegion.values[e] += endValues[e] - mStartValues[e];
+    }
+
+private:
+    ProfileRegion &mRegion;
+    const PerfCounters &mCounters;
+    std::chrono::steady_clock::time_point mStart;
+    uint64_t mStartValues[NUM_OF_PERF_EVENTS];
+};
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+
+// the rest of the enclosing scope is the region
+#define PERF_REGION(name) \
+    static ProfileRegion &PERF_CONCAT(perfRegion, __LINE__) = Profiler::get().getRegion(name); \
+    ProfileScope PERF_CONCAT(perfScope, __LINE__)(PERF_CONCAT(perfRegion, __LINE__))
+
+#define PERF_COUNT(name, n) do { \
+        static std::atomic<uint64_t> &perfCounter = Profiler::get().getCounter(name); \
+        perfCounter.fetch_add((n), std::memory_order_relaxed); \
+    } while (0)
+
+#else
+
+#define PERF_REGION(name) do {} while (0)
+#define PERF_COUNT(name, n) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+/*
+Counter-based random streams
+
+the i-th number of stream s is a pure function of (seed, s, i): a splitmix64
+finalizer applied to a Weyl sequence keyed by (seed, s). Streams share no
+state, so every thread / block / tree can own one without locking, results
+do not depend on scheduling, and any stream can jump to any position.
+
+CounterRng satisfies UniformRandomBitGenerator, so it also works with the
+<random> distributions:
+
+CounterRng rng(seed, threadIdx);
+std::normal_distribution<double> noise(0, 1);
+double x = noise(rng);
+*/
+
+#ifndef ML_COMMON_RANDOM_H
+#define ML_COMMON_RANDOM_H
+
+#include <cstdint>
+
+inline uint64_t mixBits(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+class CounterRng {
+public:
+    typedef uint64_t result_type;
+
+    CounterRng(uint64_t seed = 0, uint64_t streamIdx = 0) {
+        mKey = mixBits(seed + mixBits(streamIdx + GOLDEN_GAMMA));
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type(0); }
+
+    result_type operator()() { return mixBits(mKey + (++mCounter) * GOLDEN_GAMMA); }
+
+    // uniform in [0, 1) with 53 random bits
+    double uniform() { return ((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // uniform in [low, high)
+    double uniform(double low, double high) { return low + (high - low) * uniform(); }
+
+    // uniform integer in [0, bound), multiply-shift instead of a biased modulo
+    uint64_t below(uint64_t bound) {
+        return (uint64_t)(((unsigned __int128)(*this)() * bound) >> 64);
+    }
+
+    uint64_t getCounter() const { return mCounter; }
+    void seek(uint64_t counter) { mCounter = counter; }
+
+private:
+    static const uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ULL;
+    uint64_t mKey;
+    uint64_t mCounter = 0;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+Out-of-core row streaming for the SGD trainers
+
+rows are read in fixed-size chunks from a binary, columnar or CSV file, while a prefetch
+thread fills the next chunk, the current one is being trained on
+(double buffering). Rows can be shuffled inside a bounded window, so an epoch
+over a file much larger than RAM only keeps two chunks in memory.
+
+binary row file layout (little endian):
+    char[4]  magic "MLRB"
+    uint32   numOfCols (features + label, label last)
+    uint64   numOfRows
+    double   rows[numOfRows][numOfCols]
+
+columnar files (columnar.h) are mapped and their rows gathered from the
+columns, the last column is the label.
+
+CSV files hold one row per line, comma separated, label last, no header.
+*/
+
+#ifndef ML_COMMON_STREAMING_H
+#define ML_COMMON_STREAMING_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "columnar.h"
+
+class BinaryRowWriter {
+public:
+    BinaryRowWriter(const std::string &path, uint32_t numOfCols) {
+        mFile = fopen(path.c_str(), "wb");
+        if (mFile == nullptr) throw std::runtime_error("cannot open " + path);
+        mNumOfCols = numOfCols;
+        uint64_t numOfRows = 0;
+        fwrite("MLRB", 1, 4, mFile);
+        fwrite(&mNumOfCols, sizeof(mNumOfCols), 1, mFile);
+        fwrite(&numOfRows, sizeof(numOfRows), 1, mFile);
+    }
+
+    ~BinaryRowWriter() { close(); }
+
+    void write(const double *row) {
+        fwrite(row, sizeof(double), mNumOfCols, mFile);
+        mNumOfRows++;
+    }
+
+    // patches the row count into the header
+    void close() {
+        if (mFile == nullptr) return;
+        fseek(mFile, 4 + sizeof(mNumOfCols), SEEK_SET);
+        fwrite(&mNumOfRows, sizeof(mNumOfRows), 1, mFile);
+        fclose(mFile);
+        mFile = nullptr;
+    }
+
+private:
+    FILE *mFile;
+    uint32_t mNumOfCols;
+    uint64_t mNumOfRows = 0;
+};
+
+inline void writeBinaryRows(const std::string &path, const std::vector<std::vector<double>> &rows) {
+    BinaryRowWriter writer(path, rows[0].size());
+    for (const auto &row : rows) writer.write(row.data());
+}
+
+// row-major Dataset, features then label in each row
+inline void writeBinaryRows(const std::string &path, const Dataset &dataset) {
+    size_t numOfFeatures = dataset.numOfFeatures();
+    BinaryRowWriter writer(path, numOfFeatures + 1);
+    std::vector<double> row(numOfFeatures + 1);
+    for (size_t r=0; r<dataset.size(); r++) {
+        for (size_t c=0; c<numOfFeatures; c++) row[c] = dataset.features(r, c);
+        row[numOfFeatures] = dataset.labels[r];
+        writer.write(row.data());
+    }
+}
+
+struct RowChunk {
+    std::vector<double> values; // row-major, numOfRows x numOfCols
+    std::vector<uint32_t> order; // visiting order of the rows
+    size_t numOfRows = 0;
+};
+
+class RowStream {
+public:
+    RowStream(const std::string &path, size_t chunkRows = 1 << 16, size_t shuffleWindow = 0, unsigned seed = 0) {
+        mPath = path;
+        mChunkRows = chunkRows;
+        mShuffleWindow = std::min(shuffleWindow, chunkRows);
+        mSeed = seed;
+        detectFormat();
+    }
+
+    size_t getNumOfCols() const { return mNumOfCols; }
+
+    /**
+     * one pass over the file, calling func(const double *row) for every row,
+     * the epoch only changes the shuffle.
+     */
+    template <typename Func>
+    void forEachRow(Func func, int epoch = 0) {
+        RowChunk buffers[2];
+        bool isFilled[2] = {false, false};
+        std::mutex mtx;
+        std::condition_variable cv;
+
+        std::thread prefetcher([&]() {
+            FILE *file = mColumnar ? nullptr : openFile();
+            size_t nextRow = 0;
+            std::mt19937 rng(mSeed + epoch);
+            for (size_t i=0; ; i++) {
+                RowChunk &chunk = buffers[i % 2];
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [&]() { return !isFilled[i % 2]; });
+                }
+                if (mColumnar) {
+                    readColumnarChunk(nextRow, chunk);
+                } else {
+                    readChunk(file, chunk);
+                }
+                shuffleChunk(chunk, rng);
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    isFilled[i % 2] = true;
+                }
+                cv.notify_all();
+                if (chunk.numOfRows == 0) break;
+            }
+            if (file != nullptr) fclose(file);
+        });
+
+        for (size_t i=0; ; i++) {
+            RowChunk &chunk = buffers[i % 2];
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]() { return isFilled[i % 2]; });
+            }
+            if (chunk.numOfRows == 0) break;
+            for (uint32_t r : chunk.order) {
+                func(&chunk.values[(size_t)r * mNumOfCols]);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                isFilled[i % 2] = false;
+            }
+            cv.notify_all();
+        }
+        prefetcher.join();
+    }
+
+private:
+    std::string mPath;
+    size_t mChunkRows;
+    size_t mShuffleWindow;
+    unsigned mSeed;
+    bool mIsBinary = false;
+    size_t mNumOfCols = 0;
+    long mDataOffset = 0;
+    std::unique_ptr<ColumnarFile> mColumnar;
+
+    FILE *openFile() const {
+        FILE *file = fopen(mPath.c_str(), "rb");
+        if (file == nullptr) throw std::runtime_error("cannot open " + mPath);
+        fseek(file, mDataOffset, SEEK_SET);
+        return file;
+    }
+
+    void detectFormat() {
+        if (ColumnarFile::isColumnarFile(mPath)) {
+            mColumnar.reset(new ColumnarFile(mPath));
+            mNumOfCols = mColumnar->getNumOfCols();
+            return;
+        }
+        FILE *file = openFile();
+
+        char magic[4] = {0};
+        uint32_t numOfCols = 0;
+        uint64_t numOfRows = 0;
+        if (fread(magic, 1, 4, file) == 4 && memcmp(magic, "MLRB", 4) == 0) {
+            if (fread(&numOfCols, sizeof(numOfCols), 1, file) != 1 ||
+                fread(&numOfRows, sizeof(numOfRows), 1, file) != 1) {
+                throw std::runtime_error("truncated header in " + mPath);
+            }
+            mIsBinary = true;
+            mNumOfCols = numOfCols;
+            mDataOffset = ftell(file);
+        } else {
+            mIsBinary = false;
+            mDataOffset = 0;
+            fseek(file, 0, SEEK_SET);
+            std::string line;
+            if (!readLine(file, line)) throw std::runtime_error("empty file " + mPath);
+            mNumOfCols = std::count(line.begin(), line.end(), ',') + 1;
+        }
+        fclose(file);
+    }
+
+    static bool readLine(FILE *file, std::string &line) {
+        line.clear();
+        int c;
+        while ((c = fgetc(file)) != EOF && c != '\n') line.push_back((char)c);
+        return c != EOF || !line.empty();
+    }
+
+    void readChunk(FILE *file, RowChunk &chunk) {
+        chunk.values.resize(mChunkRows * mNumOfCols);
+        if (mIsBinary) {
+            size_t numOfValues = fread(chunk.values.data(), sizeof(double), chunk.values.size(), file);
+            chunk.numOfRows = numOfValues / mNumOfCols;
+            return;
+        }
+
+        chunk.numOfRows = 0;
+        std::string line;
+        while (chunk.numOfRows < mChunkRows && readLine(file, line)) {
+            if (line.empty()) continue;
+            double *row = &chunk.values[chunk.numOfRows * mNumOfCols];
+            const char *p = line.c_str();
+            for (size_t c=0; c<mNumOfCols; c++) {
+                char *end;
+                row[c] = strtod(p, &end);
+                p = (*end == ',') ? end + 1 : end;
+            }
+            chunk.numOfRows++;
+        }
+    }
+
+    // gathers the next rows column by column, each column is read sequentially
+    void readColumnarChunk(size_t &nextRow, RowChunk &chunk) {
+        chunk.numOfRows = std::min(mChunkRows, mColumnar->getNumOfRows() - nextRow);
+        chunk.values.resize(mChunkRows * mNumOfCols);
+        for (size_t c=0; c<mNumOfCols; c++) {
+            const double *column = mColumnar->getColumn(c) + nextRow;
+            for (size_t r=0; r<chunk.numOfRows; r++) chunk.values[r * mNumOfCols + c] = column[r];
+        }
+        nextRow += chunk.numOfRows;
+    }
+
+    // rows are only permuted inside consecutive windows of mShuffleWindow rows
+    void shuffleChunk(RowChunk &chunk, std::mt19937 &rng) {
+        chunk.order.resize(chunk.numOfRows);
+        std::iota(chunk.order.begin(), chunk.order.end(), 0);
+        if (mShuffleWindow <= 1) return;
+        for (size_t begin=0; begin<chunk.numOfRows; begin+=mShuffleWindow) {
+            size_t end = std::min(chunk.numOfRows, begin + mShuffleWindow);
+            std::shuffle(chunk.order.begin() + begin, chunk.order.begin() + end, rng);
+        }
+    }
+};
+
+#endif
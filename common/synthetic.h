@@ -0,0 +1,135 @@
+/*
+Reproducible synthetic datasets for the benchmarks
+
+getSyntheticBlobs     isotropic gaussian clusters, label = cluster index
+getSyntheticLinear    y = b0 + sum(b_i * x_i) + gaussian noise
+getSyntheticLogistic  0/1 labels drawn from sigmoid(sum(w_i * x_i))
+getSyntheticXOR       label = 1 when an even number of the first two
+                      features are negative (not linearly separable)
+
+the "model" (centers / true weights) comes from one generator seeded with
+seed, the rows are generated in fixed blocks of SYNTHETIC_BLOCK_ROWS, each
+from its own generator seeded with (seed, blockIdx). The output therefore
+only depends on (numOfRows, numOfDims, seed), not on the number of threads,
+and any prefix of a large dataset equals the smaller dataset.
+*/
+
+#ifndef ML_COMMON_SYNTHETIC_H
+#define ML_COMMON_SYNTHETIC_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "matrix.h"
+#include "random.h"
+#include "thread_pool.h"
+
+const size_t SYNTHETIC_BLOCK_ROWS = 1 << 14;
+
+inline uint64_t getSyntheticBlockSeed(uint64_t seed, uint64_t blockIdx) {
+    // neighbouring blocks get unrelated streams
+    return mixBits(seed * 0x9E3779B97F4A7C15ULL + blockIdx + 1);
+}
+
+// fillRow(rng, features, label) is called once per row, blocks run on the shared pool
+template <typename Func>
+Dataset generateSyntheticRows(size_t numOfRows, size_t numOfDims, uint64_t seed, Func fillRow) {
+    Dataset dataset(numOfRows, numOfDims);
+    size_t numOfBlocks = (numOfRows + SYNTHETIC_BLOCK_ROWS - 1) / SYNTHETIC_BLOCK_ROWS;
+    parallelFor(0, numOfBlocks, 1, [&](size_t blockBegin, size_t blockEnd) {
+        for (size_t b=blockBegin; b<blockEnd; b++) {
+            std::mt19937_64 rng(getSyntheticBlockSeed(seed, b));
+            size_t end = std::min(numOfRows, (b + 1) * SYNTHETIC_BLOCK_ROWS);
+            for (size_t r=b*SYNTHETIC_BLOCK_ROWS; r<end; r++) {
+                fillRow(rng, dataset.row(r), dataset.labels[r]);
+            }
+        }
+    });
+    return dataset;
+}
+
+inline Dataset getSyntheticBlobs(
+    size_t numOfRows, size_t numOfDims, int numOfCenters,
+    double spread = 1.0, uint64_t seed = 42) {
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(-10, 10);
+    Matrix<double> centers(numOfCenters, numOfDims);
+    for (size_t i=0; i<centers.size(); i++) centers.data()[i] = uniform(rng);
+
+    return generateSyntheticRows(numOfRows, numOfDims, seed,
+        [&](std::mt19937_64 &rowRng, double *x, double &label) {
+            std::normal_distribution<double> noise(0, spread);
+            int c = rowRng() % numOfCenters;
+            const double *center = centers.row(c);
+            for (size_t i=0; i<numOfDims; i++) x[i] = center[i] + noise(rowRng);
+            label = c;
+        });
+}
+
+// features in [-1, 1], trueCoefficents (bias first) are returned if asked for
+inline Dataset getSyntheticLinear(
+    size_t numOfRows, size_t numOfDims, double noiseStd = 0.1,
+    uint64_t seed = 42, std::vector<double> *trueCoefficents = nullptr) {
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::vector<double> coefficents(numOfDims + 1);
+    for (auto &c : coefficents) c = 3 * uniform(rng);
+    if (trueCoefficents) *trueCoefficents = coefficents;
+
+    return generateSyntheticRows(numOfRows, numOfDims, seed,
+        [&](std::mt19937_64 &rowRng, double *x, double &label) {
+            std::uniform_real_distribution<double> rowUniform(-1, 1);
+            std::normal_distribution<double> noise(0, noiseStd);
+            double y = coefficents[0];
+            for (size_t i=0; i<numOfDims; i++) {
+                x[i] = rowUniform(rowRng);
+                y += coefficents[i+1] * x[i];
+            }
+            label = y + noise(rowRng);
+        });
+}
+
+inline Dataset getSyntheticLogistic(
+    size_t numOfRows, size_t numOfDims,
+    uint64_t seed = 42, std::vector<double> *trueCoefficents = nullptr) {
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::vector<double> coefficents(numOfDims + 1);
+    coefficents[0] = 0;
+    for (size_t i=1; i<=numOfDims; i++) coefficents[i] = 3 * uniform(rng);
+    if (trueCoefficents) *trueCoefficents = coefficents;
+
+    return generateSyntheticRows(numOfRows, numOfDims, seed,
+        [&](std::mt19937_64 &rowRng, double *x, double &label) {
+            std::uniform_real_distribution<double> rowUniform(-1, 1);
+            double z = coefficents[0];
+            for (size_t i=0; i<numOfDims; i++) {
+                x[i] = rowUniform(rowRng);
+                z += coefficents[i+1] * x[i];
+            }
+            label = ((rowUniform(rowRng) + 1) / 2 < 1.0 / (1.0 + exp(-z))) ? 1 : 0;
+        });
+}
+
+// numOfDims >= 2, features beyond the first two are distractors
+inline Dataset getSyntheticXOR(
+    size_t numOfRows, size_t numOfDims = 2, double noiseStd = 0.1, uint64_t seed = 42) {
+
+    return generateSyntheticRows(numOfRows, numOfDims, seed,
+        [&](std::mt19937_64 &rowRng, double *x, double &label) {
+            std::uniform_real_distribution<double> rowUniform(-1, 1);
+            std::normal_distribution<double> noise(0, noiseStd);
+            for (size_t i=0; i<numOfDims; i++) x[i] = rowUniform(rowRng);
+            label = ((x[0] < 0) == (x[1] < 0)) ? 1 : 0;
+            x[0] += noise(rowRng);
+            x[1] += noise(rowRng);
+        });
+}
+
+#endif
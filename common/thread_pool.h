@@ -0,0 +1,337 @@
+/*
+Shared work-stealing thread pool
+
+one process-wide pool (ThreadPool::getGlobal()) runs every parallel loop, so
+k-means, tree building and scoring in one process never start more threads
+than there are cores.
+
+ThreadPool      one task deque per worker. A worker pops its own deque from
+                the back (LIFO, cache-warm) and steals from the front of the
+                others, workers on the same NUMA node first.
+TaskGroup       fork / join: run() forks a task, wait() joins all of them.
+                A waiting thread executes pending tasks instead of blocking,
+                so groups can be nested inside tasks without deadlocks.
+parallelFor     recursive halving of [begin, end) down to grainSize
+parallelReduce  fixed chunks of grainSize, partials combined in chunk order,
+                so for a given grainSize the result does not depend on the
+                number of threads or on scheduling.
+
+environment:
+    ML_NUM_THREADS  total threads of the global pool, caller included
+                    (default: hardware threads)
+    ML_PIN_THREADS  1 pins workers to cores, grouped by NUMA node (linux)
+*/
+
+#ifndef ML_COMMON_THREAD_POOL_H
+#define ML_COMMON_THREAD_POOL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <utility>
+#include <fstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// (cpu, NUMA node) of every online cpu, grouped by node, from sysfs
+inline std::vector<std::pair<int, int>> getCpusByNode() {
+    std::vector<std::pair<int, int>> cpus;
+#ifdef __linux__
+    for (int node=0; node<1024; node++) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file) {
+            if (node == 0) continue; // no NUMA information, fall through
+            break;
+        }
+        // e.g. "0-3,8-11"
+        std::string list;
+        std::getline(file, list);
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos) end = list.size();
+            std::string range = list.substr(pos, end - pos);
+            size_t dash = range.find('-');
+            int first = std::atoi(range.c_str());
+            int last = (dash == std::string::npos) ? first : std::atoi(range.c_str() + dash + 1);
+            for (int cpu=first; cpu<=last; cpu++) cpus.push_back({cpu, node});
+            pos = end + 1;
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        for (unsigned cpu=0; cpu<std::thread::hardware_concurrency(); cpu++) cpus.push_back({(int)cpu, 0});
+    }
+    return cpus;
+}
+
+class ThreadPool {
+public:
+    // numOfThreads counts the calling thread, which helps while waiting
+    ThreadPool(int numOfThreads = 0, bool pinThreads = false) {
+        if (numOfThreads <= 0) numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+        int numOfWorkers = numOfThreads - 1;
+
+        std::vector<std::pair<int, int>> cpus = getCpusByNode();
+        mNodes.resize(numOfWorkers);
+        for (int w=0; w<numOfWorkers; w++) {
+            // cpu 0 is left to the calling thread
+            mNodes[w] = cpus[(w + 1) % cpus.size()].second;
+            mQueues.emplace_back(new WorkerQueue);
+        }
+        for (int w=0; w<numOfWorkers; w++) {
+            mWorkers.emplace_back(&ThreadPool::workerLoop, this, w);
+            if (pinThreads) pinThread(mWorkers.back(), cpus[(w + 1) % cpus.size()].first);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mStop = true;
+        }
+        mWakeUp.notify_all();
+        for (auto &worker : mWorkers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    static ThreadPool &getGlobal() {
+        static ThreadPool pool(getEnvInt("ML_NUM_THREADS", 0), getEnvInt("ML_PIN_THREADS", 0) != 0);
+        return pool;
+    }
+
+    int getNumOfThreads() const { return mWorkers.size() + 1; }
+
+    // index of the calling worker thread, -1 for threads outside this pool
+    int getWorkerIdx() const { return (tCurrentPool == this) ? tWorkerIdx : -1; }
+
+    // without workers the task runs inline
+    void submit(std::function<void()> task) {
+        if (mQueues.empty()) {
+            task();
+            return;
+        }
+        int workerIdx = getWorkerIdx();
+        size_t q = (workerIdx >= 0) ? workerIdx : mNextQueue.fetch_add(1, std::memory_order_relaxed) % mQueues.size();
+        {
+            std::lock_guard<std::mutex> lock(mQueues[q]->mutex);
+            mQueues[q]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mNumOfQueued++;
+        }
+        mWakeUp.notify_one();
+    }
+
+    // runs one queued task on the calling thread, false if there was none
+    bool runPendingTask() {
+        std::function<void()> task;
+        if (!popTask(getWorkerIdx(), task)) return false;
+        task();
+        return true;
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+    std::vector<std::thread> mWorkers;
+    std::vector<int> mNodes;
+    std::atomic<size_t> mNextQueue{0};
+
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeUp;
+    size_t mNumOfQueued = 0; // guarded by mSleepMutex
+    bool mStop = false;
+
+    static thread_local const ThreadPool *tCurrentPool;
+    static thread_local int tWorkerIdx;
+
+    static int getEnvInt(const char *name, int defaultValue) {
+        const char *value = getenv(name);
+        return (value != nullptr && *value != '\0') ? atoi(value) : defaultValue;
+    }
+
+    static void pinThread(std::thread &thread, int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+    }
+
+    bool tryPop(size_t q, bool fromBack, std::function<void()> &task) {
+        WorkerQueue &queue = *mQueues[q];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        if (fromBack) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+
+    // own deque first, then steal: same NUMA node before remote nodes
+    bool popTask(int workerIdx, std::function<void()> &task) {
+        size_t numOfQueues = mQueues.size();
+        bool found = (workerIdx >= 0) && tryPop(workerIdx, true, task);
+        size_t start = (workerIdx >= 0) ? workerIdx + 1 : mNextQueue.load(std::memory_order_relaxed);
+        for (int pass=0; pass<2 && !found; pass++) {
+            for (size_t i=0; i<numOfQueues && !found; i++) {
+                size_t q = (start + i) % numOfQueues;
+                if ((int)q == workerIdx) continue;
+                bool isLocal = (workerIdx < 0) || (mNodes[q] == mNodes[workerIdx]);
+                if ((pass == 0) != isLocal) continue;
+                found = tryPop(q, false, task);
+            }
+        }
+        if (found) {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mNumOfQueued--;
+        }
+        return found;
+    }
+
+    void workerLoop(int workerIdx) {
+        tCurrentPool = this;
+        tWorkerIdx = workerIdx;
+        std::function<void()> task;
+        while (true) {
+            if (popTask(workerIdx, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mWakeUp.wait(lock, [&]() { return mStop || mNumOfQueued > 0; });
+            if (mStop) return;
+        }
+    }
+};
+
+inline thread_local const ThreadPool *ThreadPool::tCurrentPool = nullptr;
+inline thread_local int ThreadPool::tWorkerIdx = -1;
+
+class TaskGroup {
+public:
+    TaskGroup(ThreadPool &pool = ThreadPool::getGlobal()) : mPool(pool) {}
+
+    ~TaskGroup() {
+        // tasks still reference this group, never leave before they finish
+        while (mNumOfPending.load(std::memory_order_acquire) > 0) {
+            if (!mPool.runPendingTask()) std::this_thread::yield();
+        }
+    }
+
+    template <typename Func>
+    void run(Func func) {
+        mNumOfPending.fetch_add(1, std::memory_order_relaxed);
+        mPool.submit([this, func]() {
+            try {
+                func();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mErrorMutex);
+                if (!mError) mError = std::current_exception();
+            }
+            mNumOfPending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    // joins every task run so far, rethrows the first exception of a task
+    void wait() {
+        while (mNumOfPending.load(std::memory_order_acquire) > 0) {
+            if (!mPool.runPendingTask()) std::this_thread::yield();
+        }
+        if (mError) {
+            std::exception_ptr error = mError;
+            mError = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    ThreadPool &mPool;
+    std::atomic<size_t> mNumOfPending{0};
+    std::mutex mErrorMutex;
+    std::exception_ptr mError;
+};
+
+// grainSize 0 picks about 8 chunks per thread
+inline size_t getGrainSize(size_t numOfItems, size_t grainSize, const ThreadPool &pool) {
+    if (grainSize > 0) return grainSize;
+    return std::max<size_t>(1, numOfItems / (8 * pool.getNumOfThreads()));
+}
+
+template <typename Func>
+void parallelForRange(ThreadPool &pool, size_t begin, size_t end, size_t grainSize, const Func &func) {
+    if (end - begin <= grainSize) {
+        func(begin, end);
+        return;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    TaskGroup group(pool);
+    group.run([&pool, mid, end, grainSize, &func]() { parallelForRange(pool, mid, end, grainSize, func); });
+    parallelForRange(pool, begin, mid, grainSize, func);
+    group.wait();
+}
+
+// func(chunkBegin, chunkEnd) over disjoint chunks covering [begin, end)
+template <typename Func>
+void parallelFor(size_t begin, size_t end, size_t grainSize, const Func &func,
+    ThreadPool &pool = ThreadPool::getGlobal()) {
+
+    if (end <= begin) return;
+    grainSize = getGrainSize(end - begin, grainSize, pool);
+    if (pool.getNumOfThreads() == 1 || end - begin <= grainSize) {
+        func(begin, end);
+        return;
+    }
+    parallelForRange(pool, begin, end, grainSize, func);
+}
+
+// map(chunkBegin, chunkEnd, partial) accumulates into a copy of identity,
+// combine(result, partial) folds the partials in chunk order
+template <typename T, typename MapFunc, typename CombineFunc>
+T parallelReduce(size_t begin, size_t end, size_t grainSize, const T &identity,
+    const MapFunc &map, const CombineFunc &combine, ThreadPool &pool = ThreadPool::getGlobal()) {
+
+    if (end <= begin) return identity;
+    grainSize = getGrainSize(end - begin, grainSize, pool);
+    size_t numOfChunks = (end - begin + grainSize - 1) / grainSize;
+    std::vector<T> partials(numOfChunks, identity);
+    parallelFor(0, numOfChunks, 1, [&](size_t chunkBegin, size_t chunkEnd) {
+        for (size_t c=chunkBegin; c<chunkEnd; c++) {
+            map(begin + c * grainSize, std::min(end, begin + (c + 1) * grainSize), partials[c]);
+        }
+    }, pool);
+
+    T result = identity;
+    for (const auto &partial : partials) combine(result, partial);
+    return result;
+}
+
+#endif
@@ -14,37 +14,46 @@ iterations {
     3. redefine the cluster
 }
 
+bisecting k-means (large k, e.g. vector-quantization codebooks):
+flat assignment costs O(n * k) per epoch. Instead, start from one cluster
+and repeatedly split the leaf with the largest SSE in two with the Lloyd loop
+above (k = 2), until there are k leaves. The splits form a binary tree of
+centroids; a point is assigned by descending it, two distance evaluations per
+level, so about 2 * log2(k) instead of k. A beam keeps the beamWidth closest
+nodes per level, which recovers most of the points the greedy descent sends
+down the wrong branch.
+
 */
 
-#include <ctime>    // for a random seed
 #include <fstream>  // for file reading
 #include <sstream>
 #include <iostream>
 #include <vector>
 #include <cmath>    // for pow()
 #include <cfloat>   // for DBL_MAX
+#include <queue>
+#include <algorithm>
 
-using namespace std;
-
-struct Point {
-    int x, y;
-    int cluster;
-    double minDistance;
+#include "../common/matrix.h"
+#include "../common/columnar.h"
+#include "../common/thread_pool.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
+#include "../common/perf.h"
 
-    Point(int _x, int _y) {
-        x = _x;
-        y = _y;
-        cluster = -1;
-        minDistance = DBL_MAX;
-    }
+using namespace std;
 
-    double distance(Point p) {
-        return pow((this->x - p.x), 2) + pow(this->y - p.y, 2);
+double squaredDistance(const double *a, const double *b, int numOfDims) {
+    double distance = 0;
+    for (int i=0; i<numOfDims; i++) {
+        distance += pow(a[i] - b[i], 2);
     }
-};
+    return distance;
+}
 
-vector<Point> readCSV(string path) {
-    vector<Point> points;
+// one row per customer: (annual income, spending score)
+Matrix<double> readCSV(string path) {
+    vector<double> values;
     string line;
     ifstream file(path);
 
@@ -52,94 +61,513 @@ vector<Point> readCSV(string path) {
     while (getline(file, line)) {
         stringstream lineStream(line);
 
-        double x, y;
         string bit;
         getline(lineStream, bit, ',');
         getline(lineStream, bit, ',');
         getline(lineStream, bit, ',');
         getline(lineStream, bit, ',');
-        x = stof(bit);
+        values.push_back(stof(bit));
         getline(lineStream, bit, '\n');
-        y = stof(bit);
-        
-        points.push_back(Point(x, y));
+        values.push_back(stof(bit));
     }
-
     file.close();
+
+    Matrix<double> points(values.size() / 2, 2);
+    copy(values.begin(), values.end(), points.data());
     return points;
 }
 
-void kMeansClustering(vector<Point> &points, int epochs, int k) {
-    
+// fixed chunking, so the centroid sums do not depend on the number of threads
+const size_t KMEANS_GRAIN_SIZE = 4096;
+// every update chunk holds a k x (d + 1) partial that is combined serially, so
+// their number is capped no matter how many points there are
+const size_t KMEANS_MAX_UPDATE_CHUNKS = 64;
+
+size_t getUpdateGrainSize(size_t numOfPoints) {
+    return max(KMEANS_GRAIN_SIZE, (numOfPoints + KMEANS_MAX_UPDATE_CHUNKS - 1) / KMEANS_MAX_UPDATE_CHUNKS);
+}
+
+/**
+ * column-major points (e.g. mapped from a columnar file): the distances of a
+ * chunk of points to one centroid are accumulated one column at a time, so
+ * every column is read sequentially
+ */
+void assignColumnMajor(const Matrix<double> &points, const Matrix<double> &centroids, vector<int> &assignments) {
+    int numOfDims = points.cols();
+    int k = centroids.rows();
+    parallelFor(0, points.rows(), KMEANS_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        PERF_REGION("kmeans.assign");
+        PERF_COUNT("kmeans.distanceEvaluations", (end - begin) * k);
+        vector<double> minDistances(end - begin, DBL_MAX);
+        vector<double> distances(end - begin);
+        for (int c=0; c<k; c++) {
+            fill(distances.begin(), distances.end(), 0);
+            for (int i=0; i<numOfDims; i++) {
+                const double *column = points.col(i) + begin;
+                double center = centroids(c, i);
+                for (size_t p=0; p<end-begin; p++) {
+                    double diff = column[p] - center;
+                    distances[p] += diff * diff;
+                }
+            }
+            for (size_t p=0; p<end-begin; p++) {
+                if (distances[p] < minDistances[p]) {
+                    minDistances[p] = distances[p];
+                    assignments[begin + p] = c;
+                }
+            }
+        }
+    });
+}
+
+void assignRowMajor(const Matrix<double> &points, const Matrix<double> &centroids, vector<int> &assignments) {
+    int numOfDims = points.cols();
+    int k = centroids.rows();
+    parallelFor(0, points.rows(), KMEANS_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        PERF_REGION("kmeans.assign");
+        PERF_COUNT("kmeans.distanceEvaluations", (end - begin) * k);
+        for (size_t p=begin; p<end; p++) {
+            double minDistance = DBL_MAX;
+            for (int c=0; c<k; c++) {
+                double distance = squaredDistance(points.row(p), centroids.row(c), numOfDims);
+                if (distance < minDistance) {
+                    minDistance = distance;
+                    assignments[p] = c;
+                }
+            }
+        }
+    });
+}
+
+// returns the cluster index of every point, dumpIterations writes the per-epoch csv files
+vector<int> kMeansClustering(const Matrix<double> &points, int epochs, int k, bool dumpIterations = true) {
+    int numOfPoints = points.rows();
+    int numOfDims = points.cols();
+    vector<int> assignments(numOfPoints, -1);
+
     // 1. init centroids
-    vector<Point> centroids;
-    srand(time(0)); // need to set the random seed
-    int numOfPoints = points.size();
+    Matrix<double> centroids(k, numOfDims);
     for (int i=0; i<k; i++) {
-        //int pointIdx = rand() % numOfPoints;
         int pointIdx = i;
-        centroids.push_back(points.at(pointIdx));
-        centroids.back().cluster = i;
+        for (int d=0; d<numOfDims; d++) centroids(i, d) = points(pointIdx, d);
     }
 
     // do some iterations
     for (int e=0; e<epochs; e++) {
 
         // 2. assign points to a cluster
-        for (auto &point : points) {
-            point.minDistance = DBL_MAX;
-            for (int c=0; c<centroids.size(); c++) {
-                double distance = point.distance(centroids[c]);
-                if (distance < point.minDistance) {
-                    point.minDistance = distance;
-                    point.cluster = c;
-                }
-            }
+        if (points.layout() == Layout::COL_MAJOR) {
+            assignColumnMajor(points, centroids, assignments);
+        } else {
+            assignRowMajor(points, centroids, assignments);
         }
 
-        // 3. redefine centroids
-        vector<int> sizeOfEachCluster(k, 0);
-        vector<double> sumXOfEachCluster(k, 0);
-        vector<double> sumYOfEachCluster(k, 0);
-        for (auto point : points) {
-            sizeOfEachCluster[point.cluster] += 1;
-            sumXOfEachCluster[point.cluster] += point.x;
-            sumYOfEachCluster[point.cluster] += point.y;
-        }
-        for (int i=0; i<centroids.size(); i++) {
-            centroids[i].x = (sizeOfEachCluster[i] == 0) ? 0 : sumXOfEachCluster[i] / sizeOfEachCluster[i];
-            centroids[i].y = (sizeOfEachCluster[i] == 0) ? 0 : sumYOfEachCluster[i] / sizeOfEachCluster[i];
+        // 3. redefine centroids, row c of sums is (sum of each dim, count)
+        Matrix<double> sums = parallelReduce(0, numOfPoints, getUpdateGrainSize(numOfPoints), Matrix<double>(k, numOfDims + 1),
+            [&](size_t begin, size_t end, Matrix<double> &partial) {
+                PERF_REGION("kmeans.update");
+                if (points.layout() == Layout::COL_MAJOR) {
+                    for (int i=0; i<numOfDims; i++) {
+                        const double *column = points.col(i);
+                        for (size_t p=begin; p<end; p++) partial(assignments[p], i) += column[p];
+                    }
+                    for (size_t p=begin; p<end; p++) partial(assignments[p], numOfDims) += 1;
+                    return;
+                }
+                for (size_t p=begin; p<end; p++) {
+                    double *sum = partial.row(assignments[p]);
+                    const double *point = points.row(p);
+                    for (int i=0; i<numOfDims; i++) sum[i] += point[i];
+                    sum[numOfDims] += 1;
+                }
+            },
+            [](Matrix<double> &result, const Matrix<double> &partial) {
+                for (size_t i=0; i<result.size(); i++) result.data()[i] += partial.data()[i];
+            });
+        for (int c=0; c<k; c++) {
+            double sizeOfCluster = sums(c, numOfDims);
+            for (int i=0; i<numOfDims; i++) {
+                centroids(c, i) = (sizeOfCluster == 0) ? 0 : sums(c, i) / sizeOfCluster;
+            }
         }
 
         // 4. write to a file
+        if (!dumpIterations) continue;
         ofstream file1;
         file1.open("points_iter_" + to_string(e) + ".csv");
         file1 << "x,y,clusterIdx" << endl;
-        for (auto point : points) {
-            file1 << point.x << "," << point.y << "," << point.cluster << endl;
+        for (int p=0; p<numOfPoints; p++) {
+            file1 << points(p, 0) << "," << points(p, 1) << "," << assignments[p] << endl;
         }
         file1.close();
         
         ofstream file2;
         file2.open("centroids_iter_" + to_string(e) + ".csv");
         file2 << "x,y,clusterIdx" << endl;
-        for (auto centroid : centroids) {
-            file2 << centroid.x << "," << centroid.y << "," << centroid.cluster << endl;
+        for (int c=0; c<k; c++) {
+            file2 << centroids(c, 0) << "," << centroids(c, 1) << "," << c << endl;
         }
         file2.close();
 
     }
-    
+
+    return assignments;
+}
+
+// sum of squared distances to the assigned centroid (mean of its cluster)
+double getInertia(const Matrix<double> &points, const vector<int> &assignments, int k) {
+    int numOfDims = points.cols();
+    Matrix<double> centroids(k, numOfDims);
+    vector<int> sizeOfEachCluster(k, 0);
+    for (size_t p=0; p<points.rows(); p++) {
+        sizeOfEachCluster[assignments[p]]++;
+        for (int i=0; i<numOfDims; i++) centroids(assignments[p], i) += points(p, i);
+    }
+    for (int c=0; c<k; c++) {
+        for (int i=0; i<numOfDims; i++) centroids(c, i) /= max(1, sizeOfEachCluster[c]);
+    }
+    double inertia = 0;
+    if (points.layout() == Layout::COL_MAJOR) {
+        // one column at a time, like assignColumnMajor
+        for (int i=0; i<numOfDims; i++) {
+            const double *column = points.col(i);
+            for (size_t p=0; p<points.rows(); p++) {
+                double diff = column[p] - centroids(assignments[p], i);
+                inertia += diff * diff;
+            }
+        }
+        return inertia;
+    }
+    for (size_t p=0; p<points.rows(); p++) {
+        inertia += squaredDistance(points.row(p), centroids.row(assignments[p]), numOfDims);
+    }
+    return inertia;
+}
+
+/**
+ * binary tree of centroids from bisecting k-means, node 0 is the root.
+ * The children of an internal node are the consecutive nodes
+ * firstChild[node] and firstChild[node] + 1, leaves hold a codebook index.
+ */
+struct CentroidTree {
+    Matrix<double> centroids; // one row per node
+    vector<int> firstChild;   // -1 for leaves
+    vector<int> leafIdx;      // -1 for internal nodes
+    Matrix<double> codebook;  // centroids of the leaves, row = leafIdx
+    int numOfNodes = 0;
+};
+
+struct BisectingLeaf {
+    int node;
+    vector<int> members; // point indices
+    double sse;
+
+    bool operator<(const BisectingLeaf &other) const { return sse < other.sse; }
+};
+
+void setMeanAndSSE(const Matrix<double> &points, CentroidTree &tree, BisectingLeaf &leaf) {
+    int numOfDims = points.cols();
+    double *centroid = tree.centroids.row(leaf.node);
+    fill(centroid, centroid + numOfDims, 0);
+    for (int p : leaf.members) {
+        for (int i=0; i<numOfDims; i++) centroid[i] += points(p, i);
+    }
+    for (int i=0; i<numOfDims; i++) centroid[i] /= max<size_t>(1, leaf.members.size());
+    leaf.sse = 0;
+    for (int p : leaf.members) leaf.sse += squaredDistance(points.row(p), centroid, numOfDims);
+}
+
+/**
+ * splits the leaf with the largest SSE until there are k leaves (or no leaf
+ * can be split). Each split runs kMeansClustering with k = 2 on the members of
+ * the leaf, seeded with its first member and the member farthest from it.
+ */
+CentroidTree buildCentroidTree(const Matrix<double> &points, int k, int epochs) {
+    int numOfDims = points.cols();
+    CentroidTree tree;
+    tree.centroids = Matrix<double>(2 * k - 1, numOfDims);
+    tree.firstChild.assign(2 * k - 1, -1);
+    tree.leafIdx.assign(2 * k - 1, -1);
+
+    BisectingLeaf root;
+    root.node = tree.numOfNodes++;
+    root.members.resize(points.rows());
+    for (size_t p=0; p<points.rows(); p++) root.members[p] = p;
+    setMeanAndSSE(points, tree, root);
+
+    priority_queue<BisectingLeaf> leaves;
+    vector<BisectingLeaf> finalLeaves; // too small or not separable
+    leaves.push(move(root));
+    int numOfLeaves = 1;
+    while (numOfLeaves < k && !leaves.empty()) {
+        BisectingLeaf leaf = leaves.top();
+        leaves.pop();
+        if (leaf.members.size() < 2 || leaf.sse == 0) {
+            finalLeaves.push_back(move(leaf));
+            continue;
+        }
+
+        // seeds go first, kMeansClustering starts from the first k points
+        size_t farthest = 0;
+        double maxDistance = -1;
+        for (size_t m=0; m<leaf.members.size(); m++) {
+            double distance = squaredDistance(points.row(leaf.members[m]), points.row(leaf.members[0]), numOfDims);
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                farthest = m;
+            }
+        }
+        swap(leaf.members[1], leaf.members[farthest]);
+        Matrix<double> subset(leaf.members.size(), numOfDims);
+        for (size_t m=0; m<leaf.members.size(); m++) {
+            copy(points.row(leaf.members[m]), points.row(leaf.members[m]) + numOfDims, subset.row(m));
+        }
+        vector<int> assignments = kMeansClustering(subset, epochs, 2, false);
+
+        BisectingLeaf children[2];
+        for (size_t m=0; m<leaf.members.size(); m++) {
+            children[assignments[m]].members.push_back(leaf.members[m]);
+        }
+        if (children[0].members.empty() || children[1].members.empty()) {
+            finalLeaves.push_back(move(leaf));
+            continue;
+        }
+        tree.firstChild[leaf.node] = tree.numOfNodes;
+        for (auto &child : children) {
+            child.node = tree.numOfNodes++;
+            setMeanAndSSE(points, tree, child);
+            leaves.push(move(child));
+        }
+        numOfLeaves++;
+    }
+    while (!leaves.empty()) {
+        finalLeaves.push_back(leaves.top());
+        leaves.pop();
+    }
+
+    // codebook in node order, so it does not depend on the heap
+    tree.codebook = Matrix<double>(finalLeaves.size(), numOfDims);
+    int numOfCodes = 0;
+    for (int node=0; node<tree.numOfNodes; node++) {
+        if (tree.firstChild[node] >= 0) continue;
+        tree.leafIdx[node] = numOfCodes;
+        copy(tree.centroids.row(node), tree.centroids.row(node) + numOfDims, tree.codebook.row(numOfCodes));
+        numOfCodes++;
+    }
+    return tree;
 }
 
-int main() {
+// (distance, node) lists of the beam search, reused across points
+struct BeamBuffers {
+    vector<pair<double, int>> beam;
+    vector<pair<double, int>> next;
+};
+
+/**
+ * codebook index of the leaf reached by descending the tree. beamWidth 1 is
+ * the greedy descent; wider beams keep the beamWidth closest nodes of each
+ * step (leaves stay in the beam) and return the closest leaf reached.
+ */
+int assignToTree(
+    const CentroidTree &tree, const double *point, int beamWidth,
+    BeamBuffers &buffers, size_t &numOfDistances) {
+
+    int numOfDims = tree.centroids.cols();
+    if (beamWidth <= 1) {
+        int node = 0;
+        while (tree.firstChild[node] >= 0) {
+            int left = tree.firstChild[node];
+            double leftDistance = squaredDistance(point, tree.centroids.row(left), numOfDims);
+            double rightDistance = squaredDistance(point, tree.centroids.row(left + 1), numOfDims);
+            node = (leftDistance <= rightDistance) ? left : left + 1;
+            numOfDistances += 2;
+        }
+        return tree.leafIdx[node];
+    }
+
+    vector<pair<double, int>> &beam = buffers.beam;
+    vector<pair<double, int>> &next = buffers.next;
+    beam.assign(1, {0, 0});
+    while (true) {
+        next.clear();
+        bool isExpanded = false;
+        for (auto &item : beam) {
+            int child = tree.firstChild[item.second];
+            if (child < 0) {
+                next.push_back(item);
+                continue;
+            }
+            isExpanded = true;
+            for (int c=child; c<child+2; c++) {
+                next.push_back({squaredDistance(point, tree.centroids.row(c), numOfDims), c});
+                numOfDistances++;
+            }
+        }
+        if (!isExpanded) break;
+        size_t beamSize = min<size_t>(beamWidth, next.size());
+        partial_sort(next.begin(), next.begin() + beamSize, next.end());
+        next.resize(beamSize);
+        swap(beam, next);
+    }
+    return tree.leafIdx[min_element(beam.begin(), beam.end())->second];
+}
+
+vector<int> assignWithTree(const CentroidTree &tree, const Matrix<double> &points, int beamWidth) {
+    vector<int> assignments(points.rows());
+    parallelFor(0, points.rows(), KMEANS_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        PERF_REGION("kmeans.treeAssign");
+        BeamBuffers buffers;
+        size_t numOfDistances = 0;
+        for (size_t p=begin; p<end; p++) {
+            assignments[p] = assignToTree(tree, points.row(p), beamWidth, buffers, numOfDistances);
+        }
+        PERF_COUNT("kmeans.distanceEvaluations", numOfDistances);
+    });
+    return assignments;
+}
+
+double getAgreement(const vector<int> &a, const vector<int> &b) {
+    size_t numOfEqual = 0;
+    for (size_t i=0; i<a.size(); i++) numOfEqual += (a[i] == b[i]);
+    return (double)numOfEqual / a.size();
+}
+
+// build time and assignment throughput, bisecting tree vs flat Lloyd
+void runBisecting(size_t numOfRows, int k, int beamWidth) {
+    const int numOfDims = 16;
+    const int numOfEpochs = 10;
+    Dataset blobs = getSyntheticBlobs(numOfRows, numOfDims, k, 1.0);
+    CentroidTree tree;
+    double seconds = timeSeconds([&]() { tree = buildCentroidTree(blobs.features, k, numOfEpochs); });
+    cout << "bisecting build: " << tree.codebook.rows() << " leaves, " << tree.numOfNodes << " nodes, "
+        << seconds << " s" << endl;
+
+    vector<int> exact(numOfRows);
+    seconds = timeSeconds([&]() { assignRowMajor(blobs.features, tree.codebook, exact); });
+    cout << "flat assignment: " << numOfRows / seconds << " rows/s, inertia / row = "
+        << getInertia(blobs.features, exact, tree.codebook.rows()) / numOfRows << endl;
+
+    for (int beam : {1, beamWidth}) {
+        vector<int> assignments;
+        seconds = timeSeconds([&]() { assignments = assignWithTree(tree, blobs.features, beam); });
+        cout << "tree assignment, beam " << beam << ": " << numOfRows / seconds << " rows/s, "
+            << "same leaf as flat: " << getAgreement(assignments, exact)
+            << ", inertia / row = " << getInertia(blobs.features, assignments, tree.codebook.rows()) / numOfRows << endl;
+        if (beamWidth <= 1) break;
+    }
+}
+
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("k-means");
+    const int numOfEpochs = 10;
+    for (int numOfDims : {2, 16}) {
+        const int k = 8;
+        Dataset blobs = getSyntheticBlobs(numOfRows, numOfDims, k);
+        vector<int> assignments;
+        double seconds = timeSeconds([&]() {
+            assignments = kMeansClustering(blobs.features, numOfEpochs, k, false);
+        });
+        double inertia = getInertia(blobs.features, assignments, k);
+        report.add("lloyd_k8", numOfRows, numOfDims, seconds,
+            {{"inertiaPerRow", inertia / numOfRows}}, numOfEpochs);
+    }
+
+    // large k: flat Lloyd against the bisecting tree, build and assignment
+    const int largeK = 256;
+    const int numOfDims = 16;
+    Dataset blobs = getSyntheticBlobs(numOfRows, numOfDims, largeK);
+    vector<int> assignments;
+    double seconds = timeSeconds([&]() {
+        assignments = kMeansClustering(blobs.features, numOfEpochs, largeK, false);
+    });
+    report.add("lloyd_k256", numOfRows, numOfDims, seconds,
+        {{"inertiaPerRow", getInertia(blobs.features, assignments, largeK) / numOfRows}}, numOfEpochs);
+
+    CentroidTree tree;
+    seconds = timeSeconds([&]() { tree = buildCentroidTree(blobs.features, largeK, numOfEpochs); });
+    vector<int> exact(numOfRows);
+    double assignSeconds = timeSeconds([&]() { assignRowMajor(blobs.features, tree.codebook, exact); });
+    double inertia = getInertia(blobs.features, exact, tree.codebook.rows());
+    report.add("bisecting_k256_build", numOfRows, numOfDims, seconds, {{"inertiaPerRow", inertia / numOfRows}});
+    report.add("assign_flat_k256", numOfRows, numOfDims, assignSeconds, {{"inertiaPerRow", inertia / numOfRows}});
+    for (int beamWidth : {1, 4}) {
+        seconds = timeSeconds([&]() { assignments = assignWithTree(tree, blobs.features, beamWidth); });
+        report.add("assign_tree_k256_beam" + to_string(beamWidth), numOfRows, numOfDims, seconds, {
+            {"inertiaPerRow", getInertia(blobs.features, assignments, tree.codebook.rows()) / numOfRows},
+            {"sameLeafAsFlat", getAgreement(assignments, exact)},
+        });
+    }
+    report.write(outputPath);
+}
+
+/**
+ * points from a columnar file, zero-copy: the columns firstColumn..lastColumn
+ * (by name, adjacent in the file), every column but the last without names
+ */
+Matrix<double> readColumnar(const ColumnarFile &file, const string &firstColumn, const string &lastColumn) {
+    if (firstColumn.empty()) return file.getMatrix(0, file.getNumOfCols() - 1);
+    int first = file.getColumnIdx(firstColumn);
+    int last = lastColumn.empty() ? first : file.getColumnIdx(lastColumn);
+    if (first < 0 || last < 0) {
+        throw runtime_error("no column " + (first < 0 ? firstColumn : lastColumn));
+    }
+    return file.getMatrix(first, last + 1);
+}
+
+void runColumnar(string path, int k, string firstColumn, string lastColumn) {
+    if (path.empty()) {
+        path = "blobs.mlcf";
+        writeColumnar(path, getSyntheticBlobs(200000, 8, k));
+    }
+    Matrix<double> points;
+    double loadSeconds = timeSeconds([&]() { points = readColumnar(ColumnarFile(path), firstColumn, lastColumn); });
+    cout << path << ": " << points.rows() << " x " << points.cols()
+        << " mapped in " << loadSeconds * 1000 << " ms" << endl;
+
+    vector<int> assignments = kMeansClustering(points, 10, k, false);
+    cout << "inertia = " << getInertia(points, assignments, k) << endl;
+}
+
+/**
+ * usage: ./main                           (mall customers, writes points/centroids csv per iteration)
+ *        ./main columnar [path] [k] [first column] [last column]
+ *                                         (columnar file from CsvToColumnar, synthetic blobs without a path;
+ *                                          clusters the named column range, every column but the last by default)
+ *        ./main bisect [rows] [k] [beam]  (bisecting k-means tree vs flat assignment, synthetic blobs)
+ *        ./main suite [rows] [out.json]   (synthetic blobs benchmark)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "bisect") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 200000;
+        int k = (argc > 3) ? stoi(argv[3]) : 4096;
+        int beamWidth = (argc > 4) ? stoi(argv[4]) : 8;
+        runBisecting(numOfRows, k, beamWidth);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "columnar") {
+        string path = (argc > 2) ? argv[2] : "";
+        int k = (argc > 3) ? stoi(argv[3]) : 6;
+        string firstColumn = (argc > 4) ? argv[4] : "";
+        string lastColumn = (argc > 5) ? argv[5] : "";
+        runColumnar(path, k, firstColumn, lastColumn);
+        return 0;
+    }
+
     // [option 1] load csv
-    vector<Point> points = readCSV("./mall_customers.csv");
+    Matrix<double> points = readCSV("./mall_customers.csv");
     // [option 2] 
-    // vector<Point> points = {
-    //     {12, 39}, {20, 36}, {28, 30}, {18, 52}, {29, 54}, {33, 46}, {24, 55}, {45, 59}, {60, 35}, {52, 70},
-    //     {51, 66}, {52, 63}, {55, 58}, {53, 23}, {55, 58}, {53, 23}, {55, 14}, {61, 8}, {64, 19}, {69, 7}, {72, 24}
-    // };
+    // Dataset toy = Dataset::fromRows({
+    //     {12, 39, 0}, {20, 36, 0}, {28, 30, 0}, {18, 52, 0}, {29, 54, 0}, {33, 46, 0}, {24, 55, 0},
+    //     {45, 59, 0}, {60, 35, 0}, {52, 70, 0}, {51, 66, 0}, {52, 63, 0}, {55, 58, 0}, {53, 23, 0},
+    //     {55, 58, 0}, {53, 23, 0}, {55, 14, 0}, {61, 8, 0}, {64, 19, 0}, {69, 7, 0}, {72, 24, 0}
+    // });
+    // Matrix<double> points = toy.features;
 
     kMeansClustering(points, 5, 6);
-}
\ No newline at end of file
+}
@@ -3,6 +3,11 @@ knn algorithm:
 
 1. get neighbors by euclidean distance
 2. make predictions according to neigbors (classification: argmax, regression: mean)
+
+choosing k by cross-validation:
+the neighbors of a test row are the same for every k, only the vote uses
+more or less of them. So each test row is scanned once, for the largest k,
+and every smaller k is scored from a prefix of that sorted list.
 */
 
 #include <iostream>
@@ -11,30 +16,76 @@ knn algorithm:
 #include <climits>
 #include <cmath>
 #include <algorithm>
+#include <queue>
+
+#include <string>
+
+#include "../common/matrix.h"
+#include "../common/columnar.h"
+#include "../common/thread_pool.h"
+#include "../common/synthetic.h"
+#include "../common/bench.h"
+#include "../common/perf.h"
+#include "../common/cv.h"
+#include "../common/model.h"
 
 using namespace std;
 
-double euclideanDistance(vector<double> data1, vector<double> data2) {
+double euclideanDistance(const double *data1, const double *data2, int numOfFeatures) {
     double distance = 0;
-    for (int i=0; i<data1.size(); i++) {
-        distance += pow(data1[i] - data2[i], 2);
+    for (int i=0; i<numOfFeatures; i++) {
+        double diff = data1[i] - data2[i];
+        distance += diff * diff;
     }
     return sqrt(distance);
 }
 
+// column-major train set (e.g. mapped from a columnar file): squared distances
+// are accumulated one column at a time, so each column is scanned sequentially
+void getDistancesColumnMajor(
+    const Matrix<double> &features,
+    const double *testData, vector<pair<double, int>> &distIdxPairs) {
+
+    parallelFor(0, features.rows(), 8192, [&](size_t begin, size_t end) {
+        PERF_REGION("knn.scan");
+        PERF_COUNT("knn.distanceEvaluations", end - begin);
+        vector<double> distances(end - begin, 0);
+        for (size_t f=0; f<features.cols(); f++) {
+            const double *column = features.col(f) + begin;
+            for (size_t i=0; i<end-begin; i++) {
+                double diff = column[i] - testData[f];
+                distances[i] += diff * diff;
+            }
+        }
+        for (size_t i=begin; i<end; i++) {
+            distIdxPairs[i].first = sqrt(distances[i - begin]);
+            distIdxPairs[i].second = i;
+        }
+    });
+}
+
 vector<int> getNeighbors(
-    const vector<vector<double>> &trainSet, 
-    const vector<double> testData, int numOfNeighbors) {
+    const Dataset &trainSet, 
+    const double *testData, int numOfNeighbors) {
     
     // calculate distance
     vector<pair<double, int>> distIdxPairs(trainSet.size());
-    for (int i=0; i<trainSet.size(); i++) {
-        distIdxPairs[i].first = euclideanDistance(trainSet[i], testData);
-        distIdxPairs[i].second = i;
-    }    
+    if (trainSet.features.layout() == Layout::COL_MAJOR) {
+        getDistancesColumnMajor(trainSet.features, testData, distIdxPairs);
+    } else {
+        parallelFor(0, trainSet.size(), 8192, [&](size_t begin, size_t end) {
+            PERF_REGION("knn.scan");
+            PERF_COUNT("knn.distanceEvaluations", end - begin);
+            for (size_t i=begin; i<end; i++) {
+                distIdxPairs[i].first = euclideanDistance(trainSet.row(i), testData, trainSet.numOfFeatures());
+                distIdxPairs[i].second = i;
+            }
+        });
+    }
     
-    // sorting by distance
-    sort(distIdxPairs.begin(), distIdxPairs.end());
+    // sorting by distance, only the k nearest need to be in order
+    numOfNeighbors = min<int>(numOfNeighbors, distIdxPairs.size());
+    partial_sort(distIdxPairs.begin(), distIdxPairs.begin() + numOfNeighbors, distIdxPairs.end());
     
     // get indexes of k nearest neighbors
     vector<int> neighbors(numOfNeighbors);
@@ -46,8 +97,8 @@ vector<int> getNeighbors(
 }
 
 double predict(
-    const vector<vector<double>> &trainSet, 
-    const vector<double> testData, int numOfNeighbors) {
+    const Dataset &trainSet, 
+    const double *testData, int numOfNeighbors) {
     
     // get k nearest neighbors
     auto neighbors = getNeighbors(trainSet, testData, numOfNeighbors);
@@ -55,7 +106,7 @@ double predict(
     // count frequency
     unordered_map<double, int> counter;
     for (int neighbor : neighbors) {
-        double label = trainSet[neighbor][2];
+        double label = trainSet.labels[neighbor];
         if (counter.count(label) == 0) {
             counter[label] = 0;
         } else {
@@ -76,9 +127,185 @@ double predict(
     return prediction;
 }
 
-int main() {
+// the k nearest of trainRows, nearest first, ties by row index as in getNeighbors
+vector<int> getNeighborsOfRows(
+    const Dataset &dataset, const vector<int> &trainRows,
+    const double *testData, int numOfNeighbors) {
+
+    // max-heap of the k best so far, the worst on top
+    priority_queue<pair<double, int>> nearest;
+    for (int r : trainRows) {
+        pair<double, int> candidate(euclideanDistance(dataset.row(r), testData, dataset.numOfFeatures()), r);
+        if ((int)nearest.size() < numOfNeighbors) {
+            nearest.push(candidate);
+        } else if (candidate < nearest.top()) {
+            nearest.pop();
+            nearest.push(candidate);
+        }
+    }
+    PERF_COUNT("knn.distanceEvaluations", trainRows.size());
+
+    vector<int> neighbors(nearest.size());
+    for (int i=neighbors.size()-1; i>=0; i--) {
+        neighbors[i] = nearest.top().second;
+        nearest.pop();
+    }
+    return neighbors;
+}
+
+/**
+ * prediction for every k = 1 .. neighbors.size() from one sorted neighbor
+ * list: the most frequent label among the first k, ties go to the label that
+ * reached that count first (i.e. has the nearer neighbors)
+ */
+vector<double> getPrefixPredictions(const Dataset &dataset, const vector<int> &neighbors) {
+    vector<double> predictions(neighbors.size());
+    unordered_map<double, int> counter;
+    double bestLabel = -1;
+    int bestCount = 0;
+    for (size_t i=0; i<neighbors.size(); i++) {
+        double label = dataset.labels[neighbors[i]];
+        int count = ++counter[label];
+        if (count > bestCount) {
+            bestCount = count;
+            bestLabel = label;
+        }
+        predictions[i] = bestLabel;
+    }
+    return predictions;
+}
+
+// accuracy of every k = 1 .. maxK, one neighbor scan per row and fold
+void runCrossValidation(size_t numOfRows, int numOfFolds, int maxK) {
+    Dataset dataset = getSyntheticBlobs(numOfRows, 8, 8, 6.0);
+    vector<int> folds = getFoldAssignments(dataset.size(), numOfFolds);
+
+    CrossValidationResult result = crossValidate(maxK, numOfFolds, [&](int fold, double *scores) {
+        vector<int> trainRows = getFoldRows(folds, fold, false);
+        vector<int> testRows = getFoldRows(folds, fold, true);
+        vector<double> numOfCorrect = parallelReduce(0, testRows.size(), 16, vector<double>(maxK, 0),
+            [&](size_t begin, size_t end, vector<double> &partial) {
+                for (size_t i=begin; i<end; i++) {
+                    int r = testRows[i];
+                    vector<int> neighbors = getNeighborsOfRows(dataset, trainRows, dataset.row(r), maxK);
+                    vector<double> predictions = getPrefixPredictions(dataset, neighbors);
+                    for (size_t k=0; k<predictions.size(); k++) partial[k] += (predictions[k] == dataset.labels[r]);
+                }
+            },
+            [](vector<double> &result, const vector<double> &partial) {
+                for (size_t k=0; k<result.size(); k++) result[k] += partial[k];
+            });
+        for (int k=0; k<maxK; k++) scores[k] = numOfCorrect[k] / testRows.size();
+    });
+
+    vector<string> configNames;
+    for (int k=1; k<=maxK; k++) configNames.push_back("k=" + to_string(k));
+    printCrossValidation(result, configNames);
+}
+
+// brute force: every query scans the whole train set
+void runBenchmarkSuite(size_t numOfRows, string outputPath) {
+    BenchReport report("k-nn");
+    const size_t numOfQueries = 200;
+    const int k = 5;
+    for (int numOfDims : {2, 16}) {
+        Dataset blobs = getSyntheticBlobs(numOfRows + numOfQueries, numOfDims, 8, 3.0);
+        Dataset trainSet(numOfRows, numOfDims);
+        copy(blobs.row(0), blobs.row(0) + numOfRows * numOfDims, trainSet.row(0));
+        copy(blobs.labels.begin(), blobs.labels.begin() + numOfRows, trainSet.labels.begin());
+
+        int numOfCorrect = 0;
+        double seconds = timeSeconds([&]() {
+            for (size_t q=0; q<numOfQueries; q++) {
+                double prediction = predict(trainSet, blobs.row(numOfRows + q), k);
+                if (prediction == blobs.labels[numOfRows + q]) numOfCorrect++;
+            }
+        });
+        report.add("brute_force_k5", numOfRows, numOfDims, seconds, {
+            {"queriesPerSec", numOfQueries / seconds},
+            {"accuracy", (double)numOfCorrect / numOfQueries},
+        }, numOfQueries);
+    }
+    report.write(outputPath);
+}
+
+// the last numOfQueries rows of a columnar file are classified against the others
+void runColumnar(string path, int k) {
+    const size_t numOfQueries = 200;
+    if (path.empty()) {
+        path = "blobs.mlcf";
+        writeColumnar(path, getSyntheticBlobs(200000, 8, 8, 3.0));
+    }
+    ColumnarFile file(path);
+    if (file.getNumOfRows() <= numOfQueries) throw runtime_error(path + " has too few rows");
+    size_t numOfTrain = file.getNumOfRows() - numOfQueries;
+    Dataset trainSet = file.getDataset(0, numOfTrain);
+    Dataset querySet = file.getDataset(numOfTrain, file.getNumOfRows());
+
+    int numOfCorrect = 0;
+    vector<double> query(querySet.numOfFeatures());
+    for (size_t q=0; q<numOfQueries; q++) {
+        for (size_t f=0; f<query.size(); f++) query[f] = querySet.features(q, f);
+        if (predict(trainSet, query.data(), k) == querySet.labels[q]) numOfCorrect++;
+    }
+    cout << path << ": " << numOfTrain << " train rows, accuracy on last " << numOfQueries
+        << " rows = " << (double)numOfCorrect / numOfQueries << endl;
+}
+
+// train rows of synthetic blobs and k, written for the inference server
+void saveModel(string path, size_t numOfRows, int k) {
+    const size_t numOfQueries = 200;
+    Dataset blobs = getSyntheticBlobs(numOfRows + numOfQueries, 8, 8, 3.0);
+    Dataset trainSet(numOfRows, blobs.numOfFeatures());
+    copy(blobs.row(0), blobs.row(0) + numOfRows * blobs.numOfFeatures(), trainSet.row(0));
+    copy(blobs.labels.begin(), blobs.labels.begin() + numOfRows, trainSet.labels.begin());
+    KnnModel model(trainSet, k);
+    model.save(path);
+
+    vector<double> predictions(numOfQueries);
+    model.predictBatch(blobs.row(numOfRows), numOfQueries, predictions.data());
+    int numOfCorrect = 0;
+    for (size_t q=0; q<numOfQueries; q++) numOfCorrect += (predictions[q] == blobs.labels[numOfRows + q]);
+    cout << "saved " << path << ", accuracy on " << numOfQueries << " held-out rows "
+        << (double)numOfCorrect / numOfQueries << endl;
+}
+
+/**
+ * usage: ./main                           (toy dataset)
+ *        ./main cv [rows] [folds] [maxK]  (picks k = 1 .. maxK by cross-validation on synthetic blobs)
+ *        ./main columnar [path] [k]       (columnar file from CsvToColumnar, synthetic blobs without a path)
+ *        ./main save [model.mlmd] [rows] [k]  (synthetic blobs as a model file)
+ *        ./main suite [rows] [out.json]   (synthetic blobs benchmark, 200 queries)
+ */
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 100000;
+        string outputPath = (argc > 3) ? argv[3] : "bench.json";
+        runBenchmarkSuite(numOfRows, outputPath);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "cv") {
+        size_t numOfRows = (argc > 2) ? stoul(argv[2]) : 10000;
+        int numOfFolds = (argc > 3) ? stoi(argv[3]) : 5;
+        int maxK = (argc > 4) ? stoi(argv[4]) : 50;
+        runCrossValidation(numOfRows, numOfFolds, maxK);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "save") {
+        string path = (argc > 2) ? argv[2] : "knn.mlmd";
+        size_t numOfRows = (argc > 3) ? stoul(argv[3]) : 20000;
+        int k = (argc > 4) ? stoi(argv[4]) : 5;
+        saveModel(path, numOfRows, k);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "columnar") {
+        string path = (argc > 2) ? argv[2] : "";
+        int k = (argc > 3) ? stoi(argv[3]) : 5;
+        runColumnar(path, k);
+        return 0;
+    }
     
-    vector<vector<double>> trainSet = {
+    Dataset trainSet = Dataset::fromRows({
         {2.7810836,2.550537003,0},
         {1.465489372,2.362125076,0},
         {3.396561688,4.400293529,0},
@@ -89,11 +316,11 @@ int main() {
         {6.922596716,1.77106367,1},
         {8.675418651,-0.242068655,1},
         {7.673756466,3.508563011,1}
-    };
+    });
     
-    double prediciton = predict(trainSet, trainSet[0], 3);
+    double prediciton = predict(trainSet, trainSet.row(0), 3);
     cout << "input: {" 
-        << trainSet[0][0] << ", " << trainSet[0][1] 
+        << trainSet.row(0)[0] << ", " << trainSet.row(0)[1] 
         << "}, prediction: " << prediciton << endl;
     
-}
\ No newline at end of file
+}